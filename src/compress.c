@@ -0,0 +1,364 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <memory.h>
+
+#include "compress.h"
+
+/*
+ * Delta codec
+ *
+ * Encodes the XOR of two equally sized buffers as a sequence of tokens
+ * [varint unchanged][varint changed][changed bytes XOR:ed]. Changed runs
+ * are only split when at least DELTA_MIN_RUN bytes are unchanged which
+ * keeps the token overhead below the bound. Decoding XORs the changed
+ * bytes into a buffer in place, so applying a delta of (src, base) to
+ * src gives base and to base gives src.
+ */
+
+#define DELTA_MIN_RUN 8
+
+static inline uint64_t
+_compress_load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline size_t
+_compress_put_varint(uint8_t *dst, size_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        dst[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    dst[n++] = value;
+    return n;
+}
+
+static inline size_t
+_compress_get_varint(const uint8_t *src, size_t len, size_t *value)
+{
+    size_t n = 0;
+    int shift = 0;
+
+    *value = 0;
+    while (n < len && shift < 64)
+    {
+        *value |= (size_t)(src[n] & 0x7f) << shift;
+        if ((src[n++] & 0x80) == 0)
+            return n;
+        shift += 7;
+    }
+
+    return 0;
+}
+
+static inline size_t
+_compress_unchanged_run(const uint8_t *src, const uint8_t *base, size_t i, size_t len)
+{
+    size_t start = i;
+
+    while (i + 8 <= len && _compress_load64(src + i) == _compress_load64(base + i))
+        i += 8;
+
+    while (i < len && src[i] == base[i])
+        i++;
+
+    return i - start;
+}
+
+size_t
+compress_delta_encode(const uint8_t *src, const uint8_t *base, size_t len,
+                      uint8_t *dst, size_t capacity)
+{
+    size_t i, j, out;
+    size_t unchanged, changed, start, run;
+
+    i = out = 0;
+    while (i < len)
+    {
+        unchanged = _compress_unchanged_run(src, base, i, len);
+        i += unchanged;
+
+        /* find end of changed run */
+        start = i;
+        while (i < len)
+        {
+            if (i + 8 <= len && _compress_load64(src + i) != _compress_load64(base + i))
+            {
+                i += 8;
+                continue;
+            }
+
+            if (src[i] != base[i])
+            {
+                i++;
+                continue;
+            }
+
+            run = _compress_unchanged_run(src, base, i, len);
+            if (run >= DELTA_MIN_RUN || i + run == len)
+                break;
+
+            i += run;
+        }
+        changed = i - start;
+
+        if (out + 20 + changed > capacity)
+            return 0;
+
+        out += _compress_put_varint(dst + out, unchanged);
+        out += _compress_put_varint(dst + out, changed);
+        for (j = start; j < i; j++)
+            dst[out++] = src[j] ^ base[j];
+    }
+
+    return out;
+}
+
+int
+compress_delta_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t size)
+{
+    size_t n, in, pos;
+    size_t unchanged, changed;
+
+    in = pos = 0;
+    while (in < len)
+    {
+        n = _compress_get_varint(src + in, len - in, &unchanged);
+        if (n == 0)
+            return 1;
+        in += n;
+
+        n = _compress_get_varint(src + in, len - in, &changed);
+        if (n == 0)
+            return 1;
+        in += n;
+
+        if (unchanged > size - pos || changed > size - pos - unchanged
+            || changed > len - in)
+            return 1;
+
+        pos += unchanged;
+        for (n = 0; n < changed; n++)
+            dst[pos++] ^= src[in++];
+    }
+
+    return 0;
+}
+
+/*
+ * LZ codec
+ *
+ * Byte oriented LZ77 using the LZ4 block layout: a token holding the
+ * literal length and match length in its two nibbles, length
+ * extensions of 255 valued bytes, the literals and a 16 bit little
+ * endian match offset. Matches are found through a single entry hash
+ * table of 4 byte sequences, the search skips ahead faster through
+ * incompressible data. The last sequence carries literals only.
+ */
+
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+
+static inline uint32_t
+_compress_load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+_compress_lz_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static inline size_t
+_compress_lz_put_length(uint8_t *dst, size_t length)
+{
+    size_t n = 0;
+    while (length >= 255)
+    {
+        dst[n++] = 255;
+        length -= 255;
+    }
+    dst[n++] = length;
+    return n;
+}
+
+static inline size_t
+_compress_lz_get_length(const uint8_t *src, size_t len, size_t *in, size_t *length)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*in >= len)
+            return 1;
+        b = src[(*in)++];
+        *length += b;
+    } while (b == 255);
+
+    return 0;
+}
+
+/* emit one sequence, a match length of 0 ends the block */
+static size_t
+_compress_lz_sequence(uint8_t *dst, size_t capacity, size_t out,
+                      const uint8_t *literals, size_t literal_len,
+                      size_t offset, size_t match_len)
+{
+    uint8_t *token;
+
+    if (out + literal_len + (literal_len + match_len) / 255 + 8 > capacity)
+        return 0;
+
+    token = dst + out++;
+    *token = (literal_len >= 15 ? 15 : literal_len) << 4;
+    if (literal_len >= 15)
+        out += _compress_lz_put_length(dst + out, literal_len - 15);
+
+    memcpy(dst + out, literals, literal_len);
+    out += literal_len;
+
+    if (match_len == 0)
+        return out;
+
+    dst[out++] = offset & 0xff;
+    dst[out++] = offset >> 8;
+
+    match_len -= LZ_MIN_MATCH;
+    *token |= (match_len >= 15 ? 15 : match_len);
+    if (match_len >= 15)
+        out += _compress_lz_put_length(dst + out, match_len - 15);
+
+    return out;
+}
+
+size_t
+compress_lz_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    uint32_t sequence, h;
+    size_t i, ref, anchor, out, limit, end, match_len;
+
+    memset(table, 0, sizeof(table));
+
+    i = anchor = out = 0;
+    limit = (len > LZ_MATCH_LIMIT) ? len - LZ_MATCH_LIMIT : 0;
+    end = (len > LZ_LAST_LITERALS) ? len - LZ_LAST_LITERALS : 0;
+
+    while (i < limit)
+    {
+        sequence = _compress_load32(src + i);
+        h = _compress_lz_hash(sequence);
+        ref = table[h];
+        table[h] = i;
+
+        if (ref >= i || i - ref > LZ_MAX_OFFSET || _compress_load32(src + ref) != sequence)
+        {
+            /* step faster the longer no match has been found */
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        match_len = LZ_MIN_MATCH;
+        while (i + match_len + 8 <= end
+               && _compress_load64(src + ref + match_len) == _compress_load64(src + i + match_len))
+            match_len += 8;
+        while (i + match_len < end && src[ref + match_len] == src[i + match_len])
+            match_len++;
+
+        out = _compress_lz_sequence(dst, capacity, out, src + anchor, i - anchor,
+                                    i - ref, match_len);
+        if (out == 0)
+            return 0;
+
+        i += match_len;
+        anchor = i;
+    }
+
+    return _compress_lz_sequence(dst, capacity, out, src + anchor, len - anchor, 0, 0);
+}
+
+int
+compress_lz_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t size)
+{
+    uint8_t token;
+    size_t in, out, n, chunk, literal_len, match_len, offset;
+
+    in = out = 0;
+    while (in < len)
+    {
+        token = src[in++];
+
+        literal_len = token >> 4;
+        if (literal_len == 15 && _compress_lz_get_length(src, len, &in, &literal_len) != 0)
+            return 1;
+
+        if (literal_len > len - in || literal_len > size - out)
+            return 1;
+
+        memcpy(dst + out, src + in, literal_len);
+        in += literal_len;
+        out += literal_len;
+
+        /* last sequence has no match */
+        if (in == len)
+            break;
+
+        if (len - in < 2)
+            return 1;
+
+        offset = src[in] | (src[in + 1] << 8);
+        in += 2;
+
+        match_len = token & 0x0f;
+        if (match_len == 15 && _compress_lz_get_length(src, len, &in, &match_len) != 0)
+            return 1;
+        match_len += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > out || match_len > size - out)
+            return 1;
+
+        /* matches may overlap their own output, the copied pattern
+           repeats every offset bytes so copy it in doubling chunks */
+        for (n = 0; n < match_len; n += chunk)
+        {
+            chunk = offset + n;
+            if (chunk > match_len - n)
+                chunk = match_len - n;
+            memcpy(dst + out + n, dst + out - offset, chunk);
+        }
+        out += match_len;
+    }
+
+    return (out == size) ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _compress_h
+#define _compress_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* worst case size of an encoded delta of len bytes */
+#define COMPRESS_DELTA_BOUND(len) ((len) + ((len) / 64) + 16)
+
+size_t compress_delta_encode(const uint8_t *src, const uint8_t *base, size_t len,
+                             uint8_t *dst, size_t capacity);
+int compress_delta_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t size);
+
+/* worst case size of lz compressed data of len bytes */
+#define COMPRESS_LZ_BOUND(len) ((len) + ((len) / 255) + 16)
+
+size_t compress_lz_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity);
+int compress_lz_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t size);
+
+#endif /* _compress_h */
@@ -22,8 +22,15 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #include <memory.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "logger.h"
+#include "hash.h"
 #include "core.h"
 
 static void
@@ -64,6 +71,8 @@ core_api_init(core_api_t *api, const char *module)
     api->retro_serialize_size = dlsym(api->module, "retro_serialize_size");
     api->retro_serialize = dlsym(api->module, "retro_serialize");
     api->retro_unserialize = dlsym(api->module, "retro_unserialize");
+    api->retro_get_memory_data = dlsym(api->module, "retro_get_memory_data");
+    api->retro_get_memory_size = dlsym(api->module, "retro_get_memory_size");
 
     if (api->retro_get_system_info == NULL)
         goto failure;
@@ -75,116 +84,615 @@ failure:
     return 1;
 }
 
+#define safe_strdup(str) (str?strdup((char *)str):NULL)
+
 int
 core_init(core_t *core, const char *library)
 {
+    struct retro_system_info system_info;
+
     memset(core, 0, sizeof(core_t));
 
-    core->variables = json_object();
+    options_init(&core->options);
+    core->path = strdup(library);
 
-    if (core_api_init(&core->api, library) != 0)
+    if (core_load(core) != 0)
+    {
+        core_deinit(core);
         return 1;
+    }
 
-    /* get system information */
-    struct retro_system_info system_info;
+    /* get system information, kept when the library is unloaded */
+    memset(&system_info, 0, sizeof(system_info));
     core->api.retro_get_system_info(&system_info);
-    core->name = system_info.library_name;
-    core->version = system_info.library_version;
-    core->valid_extensions = system_info.valid_extensions;
+    core->name = safe_strdup(system_info.library_name);
+    core->version = safe_strdup(system_info.library_version);
+    core->valid_extensions = safe_strdup(system_info.valid_extensions);
+    core->need_fullpath = system_info.need_fullpath;
+
+    if (core->name == NULL)
+    {
+        core_deinit(core);
+        return 1;
+    }
 
     return 0;
 }
 
 void
-core_variable_set(core_t *core, const char *key, const char *value)
+core_deinit(core_t *core)
+{
+    options_deinit(&core->options);
+    core_unload(core);
+    free(core->path);
+    free(core->name);
+    free(core->version);
+    free(core->valid_extensions);
+    memset(core, 0, sizeof(core_t));
+}
+
+int
+core_load(core_t *core)
+{
+    if (core->api.module != NULL)
+        return 0;
+
+    return core_api_init(&core->api, core->path);
+}
+
+void
+core_unload(core_t *core)
+{
+    core_api_deinit(&core->api);
+    memset(&core->api, 0, sizeof(core_api_t));
+}
+
+/*
+ * Open addressing string index, slots hold an entry index + 1 so zero
+ * marks an empty slot. Sized to at most half full.
+ */
+typedef const char *(*core_index_key_t)(core_collection_t *cores, uint32_t entry);
+
+static int
+_core_index_init(core_index_t *index, size_t count)
+{
+    size_t size = 16;
+
+    while (size < count * 2)
+        size <<= 1;
+
+    index->slots = calloc(size, sizeof(uint32_t));
+    if (index->slots == NULL)
+        return 1;
+
+    index->mask = size - 1;
+    return 0;
+}
+
+static void
+_core_index_deinit(core_index_t *index)
+{
+    free(index->slots);
+    memset(index, 0, sizeof(core_index_t));
+}
+
+/* returns the slot of key, or the empty slot where it belongs */
+static size_t
+_core_index_slot(core_index_t *index, core_collection_t *cores,
+                 core_index_key_t key_of, const char *key)
+{
+    size_t slot;
+
+    slot = hash64(key, strlen(key), 0) & index->mask;
+    while (index->slots[slot] != 0
+           && strcmp(key_of(cores, index->slots[slot] - 1), key) != 0)
+        slot = (slot + 1) & index->mask;
+
+    return slot;
+}
+
+static int32_t
+_core_index_find(core_index_t *index, core_collection_t *cores,
+                 core_index_key_t key_of, const char *key)
+{
+    size_t slot;
+
+    if (index->slots == NULL)
+        return -1;
+
+    slot = _core_index_slot(index, cores, key_of, key);
+    return (int32_t)index->slots[slot] - 1;
+}
+
+static const char *
+_core_name_key(core_collection_t *cores, uint32_t entry)
+{
+    return cores->cores[entry]->name;
+}
+
+static const char *
+_core_extension_key(core_collection_t *cores, uint32_t entry)
+{
+    return cores->extensions[entry].ext;
+}
+
+static int
+_core_collection_add(core_collection_t *cores, core_t *core)
+{
+    core_t **p;
+    size_t capacity;
+
+    if (cores->count == cores->capacity)
+    {
+        capacity = cores->capacity ? cores->capacity * 2 : 16;
+        p = realloc(cores->cores, capacity * sizeof(core_t *));
+        if (p == NULL)
+            return 1;
+        cores->cores = p;
+        cores->capacity = capacity;
+    }
+
+    cores->cores[cores->count++] = core;
+    return 0;
+}
+
+static int
+_core_collection_add_extension(core_collection_t *cores, core_t *core, const char *ext, size_t len)
 {
-    json_t *var;
-    var = json_object_get(core->variables, key);
-    if (var == NULL)
+    size_t i, slot;
+    core_t **p;
+    core_extension_t *extension;
+    char key[sizeof(extension->ext)];
+
+    if (len == 0 || len >= sizeof(key))
+        return 0;
+
+    for (i = 0; i < len; i++)
+        key[i] = tolower((unsigned char)ext[i]);
+    key[len] = '\0';
+
+    slot = _core_index_slot(&cores->extension_index, cores, _core_extension_key, key);
+    if (cores->extension_index.slots[slot] == 0)
+    {
+        extension = &cores->extensions[cores->extension_count];
+        memset(extension, 0, sizeof(core_extension_t));
+        memcpy(extension->ext, key, len + 1);
+        cores->extension_index.slots[slot] = ++cores->extension_count;
+    }
+    extension = &cores->extensions[cores->extension_index.slots[slot] - 1];
+
+    /* a core listing the same extension twice is a candidate once */
+    if (extension->count > 0 && extension->cores[extension->count - 1] == core)
+        return 0;
+
+    p = realloc(extension->cores, (extension->count + 1) * sizeof(core_t *));
+    if (p == NULL)
+        return 1;
+    extension->cores = p;
+    extension->cores[extension->count++] = core;
+    return 0;
+}
+
+static int
+_core_collection_build_indexes(core_collection_t *cores)
+{
+    size_t i, total, slot;
+    const char *ps, *pe;
+
+    /* name index, first registered core wins on duplicates */
+    if (_core_index_init(&cores->names, cores->count) != 0)
+        return 1;
+
+    for (i = 0; i < cores->count; i++)
     {
-        var = json_object();
-        json_object_set_new(core->variables, key, var);
+        slot = _core_index_slot(&cores->names, cores, _core_name_key, cores->cores[i]->name);
+        if (cores->names.slots[slot] == 0)
+            cores->names.slots[slot] = i + 1;
     }
 
-    json_object_set_new(var, "value", json_string(value));
+    /* extension index, candidates in registration order */
+    total = 0;
+    for (i = 0; i < cores->count; i++)
+    {
+        for (ps = cores->cores[i]->valid_extensions; ps && *ps; ps++)
+            total += (*ps == '|');
+        total++;
+    }
+
+    cores->extensions = calloc(total ? total : 1, sizeof(core_extension_t));
+    if (cores->extensions == NULL || _core_index_init(&cores->extension_index, total) != 0)
+        return 1;
+
+    for (i = 0; i < cores->count; i++)
+    {
+        ps = cores->cores[i]->valid_extensions;
+        while (ps && *ps)
+        {
+            pe = strchr(ps, '|');
+            if (pe == NULL)
+                pe = ps + strlen(ps);
+
+            if (_core_collection_add_extension(cores, cores->cores[i], ps, pe - ps) != 0)
+                return 1;
+
+            ps = (*pe == '|') ? pe + 1 : pe;
+        }
+    }
+
+    return 0;
 }
 
-const char *
-core_variable_get(core_t *core, const char *key)
+/*
+ * Core metadata cache, maps library path to its mtime, size and system
+ * information so startup does not need to load every core. A library
+ * which failed to probe is cached without name and skipped until it
+ * changes.
+ */
+static json_t *
+_core_cache_lookup(json_t *cache, const char *path, struct stat *st)
 {
-    json_t *var, *val;
-    var = json_object_get(core->variables, key);
-    if (!json_is_object(var))
+    json_t *entry;
+
+    entry = json_object_get(cache, path);
+    if (!json_is_object(entry))
         return NULL;
 
-    val = json_object_get(var, "value");
-    if (!json_is_string(val))
+    if (json_integer_value(json_object_get(entry, "mtime")) != st->st_mtime
+        || json_integer_value(json_object_get(entry, "size")) != st->st_size)
         return NULL;
 
-    return json_string_value(val);
+    return entry;
 }
 
-int
-core_collection_init(core_collection_t *cores, const char *core_path)
+static json_t *
+_core_cache_entry(core_t *core, struct stat *st)
 {
-    int i;
-    char buf[512];
+    json_t *entry;
+
+    entry = json_object();
+    json_object_set_new(entry, "mtime", json_integer(st->st_mtime));
+    json_object_set_new(entry, "size", json_integer(st->st_size));
+
+    if (core == NULL)
+        return entry;
+
+    json_object_set_new(entry, "name", json_string(core->name));
+    if (core->version)
+        json_object_set_new(entry, "version", json_string(core->version));
+    if (core->valid_extensions)
+        json_object_set_new(entry, "extensions", json_string(core->valid_extensions));
+    json_object_set_new(entry, "need_fullpath", json_boolean(core->need_fullpath));
+
+    return entry;
+}
+
+static int
+_core_init_from_cache(core_t *core, const char *library, json_t *entry)
+{
+    if (!json_is_string(json_object_get(entry, "name")))
+        return 1;
+
+    memset(core, 0, sizeof(core_t));
+
+    options_init(&core->options);
+    core->path = strdup(library);
+    core->name = safe_strdup(json_string_value(json_object_get(entry, "name")));
+    core->version = safe_strdup(json_string_value(json_object_get(entry, "version")));
+    core->valid_extensions = safe_strdup(json_string_value(json_object_get(entry, "extensions")));
+    core->need_fullpath = json_is_true(json_object_get(entry, "need_fullpath"));
+
+    return 0;
+}
+
+#define CORE_PROBE_WORKERS_MAX 16
+
+/*
+ * Parallel probing, libraries missing from the cache are loaded by a
+ * pool of worker threads and merged back in filename order.
+ */
+typedef struct core_probe_t {
+    char path[512];
+    struct stat st;
+    json_t *cached;
     core_t *core;
+    uint64_t probe_ns;
+} core_probe_t;
+
+typedef struct core_probe_queue_t {
+    core_probe_t *probes;
+    size_t count;
+    size_t next;
+} core_probe_queue_t;
+
+static uint64_t
+_core_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+_core_probe(core_probe_t *probe)
+{
+    uint64_t start;
+
+    start = _core_now();
+
+    /* probe library once, it is loaded again when a game launches */
+    probe->core = calloc(1, sizeof(core_t));
+    if (probe->core != NULL && core_init(probe->core, probe->path) != 0)
+    {
+        free(probe->core);
+        probe->core = NULL;
+    }
+
+    if (probe->core != NULL)
+        core_unload(probe->core);
+
+    probe->probe_ns = _core_now() - start;
+}
+
+static void *
+_core_probe_worker(void *opaque)
+{
+    size_t i;
+    core_probe_queue_t *queue = opaque;
+
+    while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->count)
+    {
+        if (queue->probes[i].cached == NULL)
+            _core_probe(&queue->probes[i]);
+    }
+
+    return NULL;
+}
+
+static void
+_core_probe_all(core_probe_t *probes, size_t count, size_t misses)
+{
+    long cpus;
+    size_t i, workers;
+    pthread_t threads[CORE_PROBE_WORKERS_MAX];
+    core_probe_queue_t queue = {probes, count, 0};
+
+    if (misses == 0)
+        return;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = (cpus > 0) ? cpus : 1;
+    if (workers > misses)
+        workers = misses;
+    if (workers > CORE_PROBE_WORKERS_MAX)
+        workers = CORE_PROBE_WORKERS_MAX;
+
+    /* the calling thread is one of the workers */
+    for (i = 1; i < workers; i++)
+    {
+        if (pthread_create(&threads[i], NULL, _core_probe_worker, &queue) != 0)
+            break;
+    }
+    workers = i;
+
+    _core_probe_worker(&queue);
+
+    for (i = 1; i < workers; i++)
+        pthread_join(threads[i], NULL);
+}
+
+static int
+_core_compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+int
+core_collection_init(core_collection_t *cores, const char *core_path, const char *cache_path)
+{
+    size_t i, count, misses, capacity;
+    bool dirty;
+    char **names, **p;
+    uint64_t start;
     DIR *dir;
     struct dirent *entry;
+    core_probe_t *probes, *probe;
+    json_t *cache, *updated;
+    json_error_t err;
+
+    memset(cores, 0, sizeof(core_collection_t));
 
     dir = opendir(core_path);
+    if (dir == NULL)
+        return 1;
+
+    /* list libraries, sorted to register cores in a stable order */
+    names = NULL;
+    count = capacity = 0;
     while((entry = readdir(dir)) != NULL)
     {
         if (entry->d_type != DT_REG)
             continue;
 
-        /* Find free core slot */
-        for (i = 0; i < CORE_SLOTS; i++)
+        if (count == capacity)
         {
-            core = &cores->slots[i];
-            if (core->name == NULL)
+            capacity = capacity ? capacity * 2 : 32;
+            p = realloc(names, capacity * sizeof(char *));
+            if (p == NULL)
                 break;
+            names = p;
         }
 
-        /* All slots filled, lets end loading cores */
-        if (i == CORE_SLOTS)
-            break;
+        names[count] = strdup(entry->d_name);
+        if (names[count] != NULL)
+            count++;
+    }
+    closedir(dir);
+
+    qsort(names, count, sizeof(char *), _core_compare_names);
 
-        snprintf(buf,sizeof(buf), "%s/%s", core_path, entry->d_name);
+    probes = calloc(count ? count : 1, sizeof(core_probe_t));
+    if (probes == NULL)
+        goto out;
+
+    cache = json_load_file(cache_path, 0, &err);
+    if (!json_is_object(cache))
+    {
+        json_decref(cache);
+        cache = json_object();
+    }
+
+    misses = 0;
+    for (i = 0; i < count; i++)
+    {
+        probe = &probes[i];
+        snprintf(probe->path, sizeof(probe->path), "%s/%s", core_path, names[i]);
 
-        if (core_init(core, buf) != 0)
+        if (stat(probe->path, &probe->st) != 0)
         {
-            core->name = NULL;
+            probe->path[0] = '\0';
             continue;
         }
 
-        /* Core is loaded */
-        cores->count++;
+        probe->cached = _core_cache_lookup(cache, probe->path, &probe->st);
+        if (probe->cached == NULL)
+            misses++;
+    }
+
+    start = _core_now();
+    _core_probe_all(probes, count, misses);
+    if (misses > 0)
+        notice("core", "probed %zu libraries in %.3f ms", misses, (_core_now() - start) / 1e6);
 
-        notice("core", "%s %s loaded into slot %d", core->name, core->version, i);
+    /* rebuilt from libraries present, dropping removed ones */
+    updated = json_object();
+    dirty = false;
 
+    for (i = 0; i < count; i++)
+    {
+        probe = &probes[i];
+        if (probe->path[0] == '\0')
+            continue;
+
+        if (probe->cached != NULL)
+        {
+            json_object_set(updated, probe->path, probe->cached);
+
+            probe->core = calloc(1, sizeof(core_t));
+            if (probe->core != NULL
+                && _core_init_from_cache(probe->core, probe->path, probe->cached) != 0)
+            {
+                free(probe->core);
+                probe->core = NULL;
+            }
+        }
+        else
+        {
+            dirty = true;
+            json_object_set_new(updated, probe->path, _core_cache_entry(probe->core, &probe->st));
+        }
+
+        if (probe->core == NULL)
+            continue;
+
+        if (_core_collection_add(cores, probe->core) != 0)
+        {
+            core_deinit(probe->core);
+            free(probe->core);
+            continue;
+        }
+
+        if (probe->cached != NULL)
+            notice("core", "%s %s cached", probe->core->name, probe->core->version);
+        else
+            notice("core", "%s %s probed in %.3f ms", probe->core->name, probe->core->version,
+                   probe->probe_ns / 1e6);
     }
 
+    if (_core_collection_build_indexes(cores) != 0)
+        error("core", "failed to build core indexes");
+
+    if (json_object_size(updated) != json_object_size(cache))
+        dirty = true;
+
+    if (dirty && json_dump_file(updated, cache_path, JSON_INDENT(2)) != 0)
+        warning("core", "failed to write core cache '%s'", cache_path);
+
+    json_decref(updated);
+    json_decref(cache);
+    free(probes);
+
+out:
+    for (i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+
     return (cores->count == 0) ? 1 : 0;
 }
 
+void
+core_collection_deinit(core_collection_t *cores)
+{
+    size_t i;
+
+    for (i = 0; i < cores->extension_count; i++)
+        free(cores->extensions[i].cores);
+    free(cores->extensions);
+    _core_index_deinit(&cores->extension_index);
+    _core_index_deinit(&cores->names);
+
+    for (i = 0; i < cores->count; i++)
+    {
+        core_deinit(cores->cores[i]);
+        free(cores->cores[i]);
+    }
+    free(cores->cores);
+
+    memset(cores, 0, sizeof(core_collection_t));
+}
+
 size_t
 core_collection_size(core_collection_t *cores)
 {
     return cores->count;
 }
 
+core_t *
+core_collection_get(core_collection_t *cores, size_t index)
+{
+    return (index < cores->count) ? cores->cores[index] : NULL;
+}
+
 core_t *
 core_collection_get_by_name(core_collection_t *cores, const char *name)
 {
-    int i;
-    for (i = 0; i < cores->count; i++)
+    int32_t entry;
+
+    entry = _core_index_find(&cores->names, cores, _core_name_key, name);
+    return (entry < 0) ? NULL : cores->cores[entry];
+}
+
+/* candidate cores for a file extension, without leading dot */
+core_t **
+core_collection_get_by_extension(core_collection_t *cores, const char *ext, size_t *count)
+{
+    size_t i;
+    int32_t entry;
+    char key[sizeof(cores->extensions->ext)];
+
+    *count = 0;
+
+    for (i = 0; ext[i] != '\0'; i++)
     {
-        if (strcmp(cores->slots[i].name, name) == 0)
-            return &cores->slots[i];
+        if (i + 1 >= sizeof(key))
+            return NULL;
+        key[i] = tolower((unsigned char)ext[i]);
     }
-    return NULL;
-}
+    key[i] = '\0';
 
+    entry = _core_index_find(&cores->extension_index, cores, _core_extension_key, key);
+    if (entry < 0)
+        return NULL;
 
+    *count = cores->extensions[entry].count;
+    return cores->extensions[entry].cores;
+}
@@ -25,6 +25,7 @@
 #include <jansson.h>
 
 #include "libretro.h"
+#include "options.h"
 
 typedef struct core_api_t {
     void *module;
@@ -49,32 +50,60 @@ typedef struct core_api_t {
     size_t (*retro_serialize_size)(void);
     bool (*retro_serialize)(void *data, size_t size);
     bool (*retro_unserialize)(const void *data, size_t size);
+    void *(*retro_get_memory_data)(unsigned id);
+    size_t (*retro_get_memory_size)(unsigned id);
 } core_api_t;
 
+/*
+ * A libretro core, system information is available without the
+ * library being loaded; core_load() loads it before use of the api.
+ */
 typedef struct core_t {
     core_api_t api;
-    json_t *variables;
-    const char *name;
-    const char *version;
-    const char *valid_extensions;
+    options_t options;
+    char *path;
+    char *name;
+    char *version;
+    char *valid_extensions;
+    bool need_fullpath;
 } core_t;
 
 int core_init(core_t *core, const char *library);
-void core_variable_set(core_t *core, const char *key, const char *value);
-const char *core_variable_get(core_t *core, const char *key);
+void core_deinit(core_t *core);
+int core_load(core_t *core);
+void core_unload(core_t *core);
 
 /*
- * Core collection
+ * Core collection, a growable registry of cores with hash indexes from
+ * core name and from lower case file extension to candidate cores.
  */
-#define CORE_SLOTS 20
+typedef struct core_index_t {
+    uint32_t *slots;
+    size_t mask;
+} core_index_t;
+
+typedef struct core_extension_t {
+    char ext[32];
+    core_t **cores;
+    size_t count;
+} core_extension_t;
 
 typedef struct core_collection_t {
-    core_t slots[CORE_SLOTS];
+    core_t **cores;
     size_t count;
+    size_t capacity;
+
+    core_index_t names;
+    core_extension_t *extensions;
+    size_t extension_count;
+    core_index_t extension_index;
 } core_collection_t;
 
-int core_collection_init(core_collection_t *cores, const char *core_path);
+int core_collection_init(core_collection_t *cores, const char *core_path, const char *cache_path);
+void core_collection_deinit(core_collection_t *cores);
 size_t core_collection_size(core_collection_t *cores);
+core_t *core_collection_get(core_collection_t *cores, size_t index);
 core_t *core_collection_get_by_name(core_collection_t *cores, const char *name);
+core_t **core_collection_get_by_extension(core_collection_t *cores, const char *ext, size_t *count);
 
 #endif
\ No newline at end of file
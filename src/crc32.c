@@ -0,0 +1,402 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL
+#endif
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CRC32_HAVE_ARMV8
+#endif
+
+#include "logger.h"
+#include "crc32.h"
+
+#define CRC32_POLYNOMIAL 0xedb88320
+
+/*
+ * Kernels update a raw (not inverted) crc state, the fastest one
+ * supported by the cpu is selected once on first use.
+ */
+typedef uint32_t (*crc32_kernel_t)(uint32_t crc, const uint8_t *p, size_t len);
+
+typedef struct crc32_impl_t {
+    const char *name;
+    crc32_kernel_t update;
+} crc32_impl_t;
+
+static uint32_t _crc32_table[8][256];
+static crc32_kernel_t _crc32_kernel;
+static pthread_once_t _crc32_once = PTHREAD_ONCE_INIT;
+
+static uint32_t
+_crc32_bytewise(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len--)
+        crc = (crc >> 8) ^ _crc32_table[0][(crc ^ *p++) & 0xff];
+
+    return crc;
+}
+
+/* slice-by-8, eight table lookups per 64 bit word */
+static uint32_t
+_crc32_slice8(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint32_t lo, hi;
+
+    while (len && ((uintptr_t)p & 7))
+    {
+        crc = (crc >> 8) ^ _crc32_table[0][(crc ^ *p++) & 0xff];
+        len--;
+    }
+
+    while (len >= 8)
+    {
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = _crc32_table[7][lo & 0xff] ^
+              _crc32_table[6][(lo >> 8) & 0xff] ^
+              _crc32_table[5][(lo >> 16) & 0xff] ^
+              _crc32_table[4][lo >> 24] ^
+              _crc32_table[3][hi & 0xff] ^
+              _crc32_table[2][(hi >> 8) & 0xff] ^
+              _crc32_table[1][(hi >> 16) & 0xff] ^
+              _crc32_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    return _crc32_bytewise(crc, p, len);
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+/*
+ * Carry-less multiplication folding, four 128 bit lanes are folded
+ * 64 bytes at a time and then Barrett reduced to 32 bits. Constants
+ * are the bit reflected ones from Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction".
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+_crc32_pclmul(uint32_t crc, const uint8_t *p, size_t len)
+{
+    static const uint64_t k1k2[] __attribute__((aligned(16))) = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t k3k4[] __attribute__((aligned(16))) = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t k5k0[] __attribute__((aligned(16))) = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t poly[] __attribute__((aligned(16))) = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+    size_t tail;
+
+    if (len < 64)
+        return _crc32_slice8(crc, p, len);
+
+    tail = len & 15;
+    len -= tail;
+
+    x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    p += 64;
+    len -= 64;
+
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        p += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i *)p);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        p += 16;
+        len -= 16;
+    }
+
+    /* fold 128 to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    crc = _mm_extract_epi32(x1, 1);
+
+    return _crc32_slice8(crc, p, tail);
+}
+
+static int
+_crc32_have_pclmul(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+#ifdef CRC32_HAVE_ARMV8
+/* ARMv8 crc32 instructions implement the same reflected polynomial */
+__attribute__((target("+crc")))
+static uint32_t
+_crc32_armv8(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t v;
+
+    while (len && ((uintptr_t)p & 7))
+    {
+        crc = __crc32b(crc, *p++);
+        len--;
+    }
+
+    while (len >= 8)
+    {
+        memcpy(&v, p, 8);
+        crc = __crc32d(crc, v);
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = __crc32b(crc, *p++);
+
+    return crc;
+}
+
+static int
+_crc32_have_armv8(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#endif
+
+/* available kernels, slowest first */
+static size_t
+_crc32_impls(crc32_impl_t *impls)
+{
+    size_t count = 0;
+
+    impls[count++] = (crc32_impl_t){ "bytewise", _crc32_bytewise };
+    impls[count++] = (crc32_impl_t){ "slice-by-8", _crc32_slice8 };
+#ifdef CRC32_HAVE_PCLMUL
+    if (_crc32_have_pclmul())
+        impls[count++] = (crc32_impl_t){ "pclmul", _crc32_pclmul };
+#endif
+#ifdef CRC32_HAVE_ARMV8
+    if (_crc32_have_armv8())
+        impls[count++] = (crc32_impl_t){ "armv8", _crc32_armv8 };
+#endif
+
+    return count;
+}
+
+static void
+_crc32_init(void)
+{
+    int i, j;
+    uint32_t crc;
+    size_t count;
+    crc32_impl_t impls[4];
+
+    for (i = 0; i < 256; i++)
+    {
+        crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0);
+        _crc32_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        for (j = 1; j < 8; j++)
+            _crc32_table[j][i] = (_crc32_table[j - 1][i] >> 8)
+                ^ _crc32_table[0][_crc32_table[j - 1][i] & 0xff];
+    }
+
+    count = _crc32_impls(impls);
+    _crc32_kernel = impls[count - 1].update;
+}
+
+uint32_t
+crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&_crc32_once, _crc32_init);
+    return ~_crc32_kernel(~crc, data, len);
+}
+
+int
+crc32_file_from(const char *filename, off_t offset, uint32_t *result)
+{
+    int fd;
+    ssize_t len;
+    uint32_t crc;
+    uint8_t *buf;
+    const size_t size = 256 * 1024;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    buf = malloc(size);
+    if (buf == NULL || lseek(fd, offset, SEEK_SET) == -1)
+    {
+        free(buf);
+        close(fd);
+        return 1;
+    }
+
+    posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+
+    crc = 0;
+    while ((len = read(fd, buf, size)) > 0)
+        crc = crc32_update(crc, buf, len);
+
+    free(buf);
+    close(fd);
+
+    if (len < 0)
+        return 1;
+
+    *result = crc;
+    return 0;
+}
+
+int
+crc32_file(const char *filename, uint32_t *result)
+{
+    return crc32_file_from(filename, 0, result);
+}
+
+static uint64_t
+_crc32_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int
+crc32_bench(size_t size)
+{
+    int res = 0;
+    size_t i, n, rounds, count;
+    uint8_t *data;
+    uint32_t crc, expected = 0;
+    uint64_t start, elapsed;
+    crc32_impl_t impls[4];
+
+    pthread_once(&_crc32_once, _crc32_init);
+
+    data = malloc(size);
+    if (data == NULL)
+        return 1;
+
+    srand(0x43524333);
+    for (i = 0; i < size; i++)
+        data[i] = rand();
+
+    count = _crc32_impls(impls);
+    for (n = 0; n < count; n++)
+    {
+        /* run for at least half a second */
+        rounds = 0;
+        start = _crc32_now();
+        do
+        {
+            crc = ~impls[n].update(~0u, data, size);
+            rounds++;
+            elapsed = _crc32_now() - start;
+        } while (elapsed < 500000000ull);
+
+        if (n == 0)
+            expected = crc;
+
+        notice("crc32", "%-10s %08x %6.2f GB/s", impls[n].name, crc,
+               (double)size * rounds / elapsed);
+
+        if (crc != expected)
+        {
+            error("crc32", "%s disagrees with %s", impls[n].name, impls[0].name);
+            res = 1;
+        }
+    }
+
+    free(data);
+    return res;
+}
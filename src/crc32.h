@@ -0,0 +1,38 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _crc32_h
+#define _crc32_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+int crc32_file(const char *filename, uint32_t *result);
+
+/* crc of the file contents following offset, e.g. past a copier header */
+int crc32_file_from(const char *filename, off_t offset, uint32_t *result);
+
+/* measure throughput of every crc kernel supported by this cpu */
+int crc32_bench(size_t size);
+
+#endif /* _crc32_h */
@@ -0,0 +1,214 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <expat.h>
+
+#include "logger.h"
+#include "dat.h"
+
+typedef struct dat_parser_t {
+    XML_Parser parser;
+    dat_entry_callback_t callback;
+    void *opaque;
+
+    bool in_header;
+    bool in_header_name;
+    char system[256];
+    size_t system_len;
+    char game[512];
+    int failed;
+} dat_parser_t;
+
+static const char *
+_dat_attribute(const XML_Char **attrs, const char *name)
+{
+    for (; attrs[0]; attrs += 2)
+    {
+        if (strcmp(attrs[0], name) == 0)
+            return attrs[1];
+    }
+
+    return NULL;
+}
+
+/* "Title (USA, Europe) (Rev 1)" is title "Title" and region "USA, Europe" */
+static void
+_dat_split_name(const char *game, dat_entry_t *entry)
+{
+    const char *open, *close;
+    size_t len;
+
+    open = strstr(game, " (");
+    len = open ? (size_t)(open - game) : strlen(game);
+    snprintf(entry->title, sizeof(entry->title), "%.*s", (int)len, game);
+
+    entry->region[0] = '\0';
+    if (open == NULL)
+        return;
+
+    close = strchr(open, ')');
+    if (close == NULL)
+        return;
+
+    snprintf(entry->region, sizeof(entry->region), "%.*s", (int)(close - open - 2), open + 2);
+}
+
+static void XMLCALL
+_dat_start_element(void *opaque, const XML_Char *name, const XML_Char **attrs)
+{
+    const char *value;
+    dat_entry_t entry;
+    dat_parser_t *dat = opaque;
+
+    if (strcmp(name, "header") == 0)
+    {
+        dat->in_header = true;
+        return;
+    }
+
+    if (dat->in_header && strcmp(name, "name") == 0)
+    {
+        dat->in_header_name = true;
+        dat->system_len = 0;
+        return;
+    }
+
+    /* mame style dats use machine instead of game */
+    if (strcmp(name, "game") == 0 || strcmp(name, "machine") == 0)
+    {
+        value = _dat_attribute(attrs, "name");
+        snprintf(dat->game, sizeof(dat->game), "%s", value ? value : "");
+        return;
+    }
+
+    if (strcmp(name, "rom") != 0 || dat->game[0] == '\0')
+        return;
+
+    value = _dat_attribute(attrs, "crc");
+    if (value == NULL)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.crc32 = strtoul(value, NULL, 16);
+    value = _dat_attribute(attrs, "size");
+    entry.size = value ? strtoull(value, NULL, 10) : 0;
+    entry.rom = _dat_attribute(attrs, "name");
+    entry.game = dat->game;
+    entry.system = dat->system;
+    _dat_split_name(dat->game, &entry);
+
+    if (dat->callback(dat->opaque, &entry) != 0)
+    {
+        dat->failed = 1;
+        XML_StopParser(dat->parser, XML_FALSE);
+    }
+}
+
+static void XMLCALL
+_dat_end_element(void *opaque, const XML_Char *name)
+{
+    dat_parser_t *dat = opaque;
+
+    if (strcmp(name, "header") == 0)
+        dat->in_header = false;
+    else if (strcmp(name, "name") == 0)
+        dat->in_header_name = false;
+    else if (strcmp(name, "game") == 0 || strcmp(name, "machine") == 0)
+        dat->game[0] = '\0';
+}
+
+static void XMLCALL
+_dat_character_data(void *opaque, const XML_Char *s, int len)
+{
+    dat_parser_t *dat = opaque;
+
+    if (!dat->in_header_name)
+        return;
+
+    /* character data may arrive in several pieces */
+    if (len > (int)(sizeof(dat->system) - 1 - dat->system_len))
+        len = sizeof(dat->system) - 1 - dat->system_len;
+
+    memcpy(dat->system + dat->system_len, s, len);
+    dat->system_len += len;
+    dat->system[dat->system_len] = '\0';
+}
+
+/*
+ * Stream a DAT file through expat, callback is invoked for each rom
+ * with a crc. A non zero return from callback aborts the parse.
+ */
+int
+dat_parse(const char *filename, dat_entry_callback_t callback, void *opaque)
+{
+    FILE *fp;
+    size_t len;
+    int done, res = 1;
+    dat_parser_t dat;
+    char buf[64 * 1024];
+
+    fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        error("dat", "failed to open '%s'", filename);
+        return 1;
+    }
+
+    memset(&dat, 0, sizeof(dat));
+    dat.callback = callback;
+    dat.opaque = opaque;
+    dat.parser = XML_ParserCreate(NULL);
+    if (dat.parser == NULL)
+    {
+        fclose(fp);
+        return 1;
+    }
+
+    XML_SetUserData(dat.parser, &dat);
+    XML_SetElementHandler(dat.parser, _dat_start_element, _dat_end_element);
+    XML_SetCharacterDataHandler(dat.parser, _dat_character_data);
+
+    do
+    {
+        len = fread(buf, 1, sizeof(buf), fp);
+        done = len < sizeof(buf);
+
+        if (XML_Parse(dat.parser, buf, len, done) == XML_STATUS_ERROR)
+        {
+            if (!dat.failed)
+                error("dat", "'%s' line %lu: %s", filename,
+                      XML_GetCurrentLineNumber(dat.parser),
+                      XML_ErrorString(XML_GetErrorCode(dat.parser)));
+            goto out;
+        }
+    } while (!done);
+
+    res = ferror(fp) ? 1 : 0;
+
+out:
+    XML_ParserFree(dat.parser);
+    fclose(fp);
+    return res;
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _dat_h
+#define _dat_h
+
+#include <stdint.h>
+
+/*
+ * One rom of a Logiqx XML DAT file (No-Intro, Redump, clrmamepro), title
+ * and region are split from the game name by No-Intro naming convention,
+ * "Title (Region) (Rev 1)".
+ */
+typedef struct dat_entry_t {
+    const char *system;
+    const char *game;
+    const char *rom;
+    char title[256];
+    char region[64];
+    uint64_t size;
+    uint32_t crc32;
+} dat_entry_t;
+
+typedef int (*dat_entry_callback_t)(void *opaque, const dat_entry_t *entry);
+
+int dat_parse(const char *filename, dat_entry_callback_t callback, void *opaque);
+
+#endif /* _dat_h */
@@ -30,6 +30,7 @@ extern scene_t splash_scene;
 extern scene_t main_scene;
 extern scene_t run_game_scene;
 extern scene_t in_game_menu_scene;
+extern scene_t search_scene;
 
 logger_level_t g_log_level = LOG_NOTICE;
 
@@ -45,28 +46,145 @@ _engine_handle_event(engine_t *engine, SDL_Event *event)
 static int
 _engine_tick(engine_t *engine)
 {
+    /* every tick starts a new profiler frame */
+    if (profiler_frame(&engine->profiler) && engine->profiler.record)
+        hitch_record(&engine->hitch, &engine->profiler);
+
     return scene_tick(engine->stack[engine->stack_idx]) | overlay_tick(&engine->overlay);
 }
 
 static void
 _engine_render(engine_t *engine)
 {
+    uint64_t t;
+
+    t = profiler_begin(&engine->profiler);
     scene_render(engine->stack[engine->stack_idx], engine->renderer);
 
     overlay_render(&engine->overlay, engine->renderer);
+    profiler_end(&engine->profiler, PROFILER_RENDER, t);
 
+    t = profiler_begin(&engine->profiler);
     SDL_RenderPresent(engine->renderer);
+    profiler_end(&engine->profiler, PROFILER_PRESENT, t);
 }
 
 static void
 _engine_scan_roms(engine_t *engine)
 {
     char alt[2046];
+    const char *directory;
+
     snprintf(alt, sizeof(alt), "%s/Games/emulation", getenv("HOME"));
-    notice("engine", "scanning directory %s for available roms",
-        config_get(&engine->config, "/hjortron/directories/roms", alt));
-    scraper_scan_directory(&engine->scraper, &engine->cores,
-        config_get(&engine->config, "/hjortron/directories/roms", alt));
+    directory = config_get(&engine->config, "/hjortron/directories/roms", alt);
+
+    /* watch before the scan so that changes made during it are seen */
+    engine->watcher.fd = -1;
+    if (strcmp("true", config_get(&engine->config, "/hjortron/watch/enable", "true")) == 0)
+        watcher_init(&engine->watcher, directory,
+                     strtoul(config_get(&engine->config, "/hjortron/watch/delay", "500"), NULL, 10));
+
+    notice("engine", "scanning directory %s for available roms", directory);
+    scraper_scan_directory(&engine->scraper, &engine->cores, directory);
+}
+
+static void
+_engine_rescan_directory(void *opaque, const char *directory)
+{
+    engine_t *engine = opaque;
+    engine_rescan_t *rescan = &engine->rescan;
+    char **dirs;
+
+    if (rescan->count == rescan->capacity)
+    {
+        size_t capacity = rescan->capacity ? rescan->capacity * 2 : 8;
+        dirs = realloc(rescan->dirs, capacity * sizeof(char *));
+        if (dirs == NULL)
+        {
+            warning("engine", "dropped rescan of changed directory %s", directory);
+            return;
+        }
+        rescan->dirs = dirs;
+        rescan->capacity = capacity;
+    }
+
+    rescan->dirs[rescan->count++] = strdup(directory);
+}
+
+static void *
+_engine_rescan_thread(void *opaque)
+{
+    engine_t *engine = opaque;
+    engine_rescan_t *rescan = &engine->rescan;
+    scraper_t scraper;
+    size_t i;
+
+    if (scraper_init(&scraper, rescan->database) == 0)
+    {
+        for (i = 0; i < rescan->count; i++)
+        {
+            notice("engine", "rescanning changed directory %s", rescan->dirs[i]);
+            scraper_scan_directory(&scraper, &engine->cores, rescan->dirs[i]);
+        }
+        rescan->changed = scraper.generation != 0;
+    }
+    scraper_deinit(&scraper);
+
+    __atomic_store_n(&rescan->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void
+_engine_rescan_finish(engine_t *engine)
+{
+    engine_rescan_t *rescan = &engine->rescan;
+    size_t i;
+
+    /* the game list reloads on the next tick */
+    if (rescan->changed)
+        engine->scraper.generation++;
+
+    for (i = 0; i < rescan->count; i++)
+        free(rescan->dirs[i]);
+    rescan->count = 0;
+    rescan->running = false;
+}
+
+/*
+ * Apply settled changes of the rom tree while the game list is shown,
+ * a running game keeps its frame budget and picks them up afterwards.
+ * The scan itself runs off the main loop which only polls for it.
+ */
+static void
+_engine_watch_roms(engine_t *engine)
+{
+    engine_rescan_t *rescan = &engine->rescan;
+
+    if (rescan->running)
+    {
+        if (!__atomic_load_n(&rescan->done, __ATOMIC_ACQUIRE))
+            return;
+        pthread_join(rescan->thread, NULL);
+        _engine_rescan_finish(engine);
+    }
+
+    if (engine->stack[engine->stack_idx] != &main_scene)
+        return;
+
+    if (watcher_poll(&engine->watcher, _engine_rescan_directory, engine) == 0
+        || rescan->count == 0)
+        return;
+
+    rescan->done = false;
+    rescan->changed = false;
+    if (pthread_create(&rescan->thread, NULL, _engine_rescan_thread, engine) != 0)
+    {
+        warning("engine", "failed to start rescan thread, rescanning in place");
+        _engine_rescan_thread(engine);
+        _engine_rescan_finish(engine);
+        return;
+    }
+    rescan->running = true;
 }
 
 int
@@ -79,13 +197,19 @@ engine_init(engine_t *engine)
     if (config_init(&engine->config) != 0)
       return 1;
 
-    if (scraper_init(&engine->scraper) != 0)
+    if (scraper_init(&engine->scraper,
+        config_get(&engine->config, "/hjortron/database", "./hjortron.db")) != 0)
+      return 1;
+    engine->rescan.database = strdup(config_get(&engine->config, "/hjortron/database", "./hjortron.db"));
+
+    if (savestate_init(&engine->savestate) != 0)
       return 1;
 
     /* initialize collection of cores */
     notice("engine", "scanning for availble libretro cores");
     if (core_collection_init(&engine->cores,
-        config_get(&engine->config, "/hjortron/directories/cores", "/usr/lib/libretro")) != 0)
+        config_get(&engine->config, "/hjortron/directories/cores", "/usr/lib/libretro"),
+        config_get(&engine->config, "/hjortron/cores/cache", "./hjortron-cores.json")) != 0)
     {
         error("engine", "no libretro cores was found at path '%s'",
             config_get(&engine->config, "/hjortron/directories/cores", "/usr/lib/libretro"));
@@ -102,6 +226,7 @@ engine_init(engine_t *engine)
     main_scene.engine = engine;
     run_game_scene.engine = engine;
     in_game_menu_scene.engine = engine;
+    search_scene.engine = engine;
 
     /* initialize SDL */
     if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO|SDL_INIT_GAMECONTROLLER) < 0)
@@ -134,6 +259,16 @@ engine_init(engine_t *engine)
     engine->overlay.engine = engine;
     overlay_init(&engine->overlay, engine->renderer, w * 0.10);
 
+    if (profiler_init(&engine->profiler, engine->renderer,
+                      config_get(&engine->config, "/hjortron/font", "./font.ttf"), w * 0.03) != 0)
+        warning("engine", "failed to initialize profiler");
+
+    /* record frame breakdowns for hitch reports, budget 0 disables */
+    hitch_init(&engine->hitch,
+               strtoul(config_get(&engine->config, "/hjortron/hitch/budget", "34"), NULL, 10),
+               config_get(&engine->config, "/hjortron/hitch/log", "/tmp/hjortron-hitch.log"));
+    profiler_record(&engine->profiler, engine->hitch.budget_us > 0);
+
     /* mount blank scene */
     SDL_Color white = {0xff, 0xff, 0xff};
     if (blank_scene.mount(&blank_scene, &white) != 0)
@@ -162,6 +297,8 @@ engine_init(engine_t *engine)
 void
 engine_deinit(engine_t *engine)
 {
+    profiler_deinit(&engine->profiler);
+
     TTF_CloseFont(engine->font);
     TTF_Quit();
 
@@ -170,13 +307,61 @@ engine_deinit(engine_t *engine)
 
     SDL_Quit();
 
+    savestate_deinit(&engine->savestate);
+    watcher_deinit(&engine->watcher);
+    if (engine->rescan.running)
+    {
+        pthread_join(engine->rescan.thread, NULL);
+        _engine_rescan_finish(engine);
+    }
+    free(engine->rescan.dirs);
+    free(engine->rescan.database);
+    core_collection_deinit(&engine->cores);
     scraper_deinit(&engine->scraper);
     config_deinit(&engine->config);
 }
 
+static int
+_engine_transform_keyboard_event_to_trigger(SDL_Event *event)
+{
+    uint8_t axis;
+    int16_t value;
+
+    if (event->type != SDL_KEYDOWN && event->type != SDL_KEYUP)
+        return 0;
+
+    switch(event->key.keysym.scancode)
+    {
+        case SDL_SCANCODE_BACKSPACE:
+            axis = SDL_CONTROLLER_AXIS_TRIGGERLEFT;
+            break;
+        case SDL_SCANCODE_TAB:
+            axis = SDL_CONTROLLER_AXIS_TRIGGERRIGHT;
+            break;
+
+        default:
+            /* not a trigger key */
+            return 0;
+    }
+
+    if (event->type == SDL_KEYDOWN && event->key.repeat != 0)
+        return 1;
+
+    value = (event->type == SDL_KEYDOWN) ? 32767 : 0;
+
+    event->type = SDL_CONTROLLERAXISMOTION;
+    event->caxis.axis = axis;
+    event->caxis.value = value;
+    return 1;
+}
+
 static void
 _engine_transform_keyboard_event_to_gamecontroller(SDL_Event *event)
 {
+    /* analog triggers are axis events on a game controller */
+    if (_engine_transform_keyboard_event_to_trigger(event))
+        return;
+
     if (event->type == SDL_KEYDOWN)
     {
         if (event->key.repeat != 0)
@@ -264,9 +449,13 @@ engine_run(engine_t *engine)
             if (event.type != SDL_KEYDOWN || event.type != SDL_KEYUP)
                 _engine_handle_event(engine, &event);
 
+            profiler_event(&engine->profiler);
+
             if (event.type == SDL_QUIT)
                 quit = 1;
         }
+        _engine_watch_roms(engine);
+
         if (_engine_tick(engine))
             _engine_render(engine);
     }
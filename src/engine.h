@@ -22,22 +22,51 @@
 #ifndef _engine_h
 #define _engine_h
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <SDL_ttf.h>
 
 #include "logger.h"
 #include "overlay.h"
+#include "profiler.h"
+#include "hitch.h"
+#include "savestate.h"
 #include "scraper.h"
+#include "watcher.h"
 #include "config.h"
 #include "core.h"
 #include "scene.h"
 
 #define SCENE_STACK_SIZE 5
 
+/*
+ * Changed directories reported by the watcher are scanned by a thread
+ * with a connection of its own, done is set by the thread once it has
+ * finished and the main loop joins it.
+ */
+typedef struct engine_rescan_t
+{
+    pthread_t thread;
+    bool running;
+    bool done;
+    bool changed;
+    char *database;
+
+    char **dirs;
+    size_t count;
+    size_t capacity;
+} engine_rescan_t;
+
 typedef struct engine_t
 {
     config_t config;
     scraper_t scraper;
     overlay_t overlay;
+    profiler_t profiler;
+    hitch_t hitch;
+    savestate_t savestate;
+    watcher_t watcher;
+    engine_rescan_t rescan;
 
     core_collection_t cores;
 
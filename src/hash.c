@@ -0,0 +1,139 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <memory.h>
+
+#include "hash.h"
+
+/*
+ * 64 bit non-cryptographic hash, an implementation of the XXH64
+ * algorithm. Fast enough to hash full states and video frames every
+ * frame.
+ */
+
+#define PRIME64_1 0x9e3779b185ebca87ull
+#define PRIME64_2 0xc2b2ae3d27d4eb4full
+#define PRIME64_3 0x165667b19e3779f9ull
+#define PRIME64_4 0x85ebca77c2b2ae63ull
+#define PRIME64_5 0x27d4eb2f165667c5ull
+
+static inline uint64_t
+_hash_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+_hash_read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+_hash_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+_hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = _hash_rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t
+_hash_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= _hash_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t
+hash64(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+    uint64_t h, v1, v2, v3, v4;
+
+    if (len >= 32)
+    {
+        v1 = seed + PRIME64_1 + PRIME64_2;
+        v2 = seed + PRIME64_2;
+        v3 = seed;
+        v4 = seed - PRIME64_1;
+
+        do
+        {
+            v1 = _hash_round(v1, _hash_read64(p));
+            v2 = _hash_round(v2, _hash_read64(p + 8));
+            v3 = _hash_round(v3, _hash_read64(p + 16));
+            v4 = _hash_round(v4, _hash_read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = _hash_rotl(v1, 1) + _hash_rotl(v2, 7) + _hash_rotl(v3, 12) + _hash_rotl(v4, 18);
+        h = _hash_merge(h, v1);
+        h = _hash_merge(h, v2);
+        h = _hash_merge(h, v3);
+        h = _hash_merge(h, v4);
+    }
+    else
+    {
+        h = seed + PRIME64_5;
+    }
+
+    h += len;
+
+    while (p + 8 <= end)
+    {
+        h ^= _hash_round(0, _hash_read64(p));
+        h = _hash_rotl(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)_hash_read32(p) * PRIME64_1;
+        h = _hash_rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end)
+    {
+        h ^= (*p) * PRIME64_5;
+        h = _hash_rotl(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
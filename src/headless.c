@@ -0,0 +1,704 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <memory.h>
+
+#include "logger.h"
+#include "crc32.h"
+#include "hash.h"
+#include "vfs.h"
+#include "rewind.h"
+#include "headless.h"
+
+#define HEADLESS_VERIFY_SEED 0x48524f4eu
+
+static headless_t *_headless;
+
+static uint64_t
+_headless_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+_headless_retro_log_printf(enum retro_log_level level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (level < RETRO_LOG_WARN)
+        return;
+
+    va_start(args, fmt);
+    fprintf(stderr, "RETRO[%d]: ", level);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+static void
+_headless_retro_video_refresh_callback(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+    uint8_t *buffer;
+    uint64_t start;
+    size_t size;
+    unsigned y;
+
+    start = _headless_now();
+
+    /* hash visible pixels only, pitch padding is not guaranteed to be
+       initialized; a dupe frame keeps the previous hash */
+    if (_headless->hash_video && data != NULL)
+    {
+        _headless->video_hash = 0;
+        for (y = 0; y < height; y++)
+            _headless->video_hash = hash64((const uint8_t *)data + y * pitch,
+                                           width * _headless->pixel_size,
+                                           _headless->video_hash);
+    }
+
+    /* copy frame as the frontend would upload it, NULL means dupe */
+    size = pitch * height;
+    if (data != NULL)
+    {
+        if (size > _headless->video_size)
+        {
+            buffer = realloc(_headless->video, size);
+            if (buffer != NULL)
+            {
+                _headless->video = buffer;
+                _headless->video_size = size;
+            }
+        }
+
+        if (size <= _headless->video_size)
+            memcpy(_headless->video, data, size);
+    }
+
+    _headless->stats.video_ns += _headless_now() - start;
+    _headless->stats.video_calls++;
+}
+
+static void
+_headless_retro_audio_sample_callback(int16_t left, int16_t right)
+{
+}
+
+static size_t
+_headless_retro_audio_sample_batch_callback(const int16_t *data, size_t frames)
+{
+    size_t len;
+    uint64_t start;
+
+    start = _headless_now();
+
+    /* consume samples into a scratch buffer in place of the pcm device */
+    len = frames * 2;
+    if (len > HEADLESS_AUDIO_SAMPLES)
+        len = HEADLESS_AUDIO_SAMPLES;
+    memcpy(_headless->audio, data, len * sizeof(int16_t));
+
+    _headless->stats.audio_ns += _headless_now() - start;
+    _headless->stats.audio_calls++;
+    return frames;
+}
+
+static void
+_headless_retro_input_poll_callback(void)
+{
+}
+
+static int16_t
+_headless_retro_input_state_callback(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+    int16_t state;
+    uint64_t start;
+
+    start = _headless_now();
+
+    state = 0;
+    if (device == RETRO_DEVICE_JOYPAD && port == 0)
+        state = (_headless->joypad_state >> id) & 1;
+
+    _headless->stats.input_ns += _headless_now() - start;
+    _headless->stats.input_calls++;
+    return state;
+}
+
+static bool
+_headless_retro_environment_callback(unsigned cmd, void *data)
+{
+    switch (cmd)
+    {
+        case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+        {
+            bool *pval = data;
+            *pval = true;
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+        {
+            const enum retro_pixel_format *pval = data;
+            _headless->pixel_size = (*pval == RETRO_PIXEL_FORMAT_XRGB8888) ? 4 : 2;
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_SET_PERFORMANCE_LEVEL:
+        case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
+        case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+        case RETRO_ENVIRONMENT_SET_SUBSYSTEM_INFO:
+        case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
+            return true;
+
+        case RETRO_ENVIRONMENT_GET_INPUT_DEVICE_CAPABILITIES:
+        {
+            uint64_t *pval = data;
+            *pval = (1 << RETRO_DEVICE_JOYPAD);
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+        {
+            const char **pval = data;
+            *pval = "./";
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+        {
+            const char **pval = data;
+            *pval = "/tmp";
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+        {
+            struct retro_log_callback *pval = data;
+            pval->log = _headless_retro_log_printf;
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_VARIABLE:
+        {
+            struct retro_variable *pvar = data;
+            pvar->value = options_get(&_headless->core.options, pvar->key);
+            return pvar->value != NULL;
+        } break;
+
+        case RETRO_ENVIRONMENT_SET_VARIABLES:
+            return options_define(&_headless->core.options, data) == 0;
+
+        case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+        {
+            bool *presult = data;
+            *presult = options_updated(&_headless->core.options);
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_VFS_INTERFACE:
+        {
+            struct retro_vfs_interface_info *pval = data;
+            pval->iface = vfs_interface();
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+        {
+            int *pval = data;
+            *pval = (1<<0) | (1<<1);
+            return true;
+        } break;
+
+        default:
+            break;
+    }
+    return false;
+}
+
+int
+headless_init(headless_t *headless, const char *core_path, const char *rom_path)
+{
+    struct retro_game_info game = {0};
+
+    memset(headless, 0, sizeof(headless_t));
+    headless->pixel_size = 2;
+    _headless = headless;
+
+    if (crc32_file(rom_path, &headless->rom_crc32) != 0)
+    {
+        error("headless", "failed to read rom '%s'", rom_path);
+        return 1;
+    }
+
+    if (core_init(&headless->core, core_path) != 0)
+    {
+        error("headless", "failed to load core '%s'", core_path);
+        return 1;
+    }
+
+    headless->core.api.retro_set_environment(_headless_retro_environment_callback);
+    headless->core.api.retro_set_video_refresh(_headless_retro_video_refresh_callback);
+    headless->core.api.retro_set_audio_sample(_headless_retro_audio_sample_callback);
+    headless->core.api.retro_set_audio_sample_batch(_headless_retro_audio_sample_batch_callback);
+    headless->core.api.retro_set_input_poll(_headless_retro_input_poll_callback);
+    headless->core.api.retro_set_input_state(_headless_retro_input_state_callback);
+
+    headless->core.api.retro_init();
+
+    game.path = rom_path;
+    if (!headless->core.api.retro_load_game(&game))
+    {
+        error("headless", "core %s failed to load '%s'", headless->core.name, rom_path);
+        headless->core.api.retro_deinit();
+        core_deinit(&headless->core);
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+headless_deinit(headless_t *headless)
+{
+    headless->core.api.retro_unload_game();
+    headless->core.api.retro_deinit();
+    core_deinit(&headless->core);
+    free(headless->video);
+    _headless = NULL;
+}
+
+static int
+_headless_open_movie(headless_t *headless, const char *movie_path)
+{
+    if (movie_open(&headless->movie, movie_path) != 0)
+    {
+        error("headless", "failed to open movie '%s'", movie_path);
+        return 1;
+    }
+
+    if (strcmp(headless->movie.header.core_name, headless->core.name) != 0)
+    {
+        error("headless", "movie was recorded with core '%s', not '%s'",
+              headless->movie.header.core_name, headless->core.name);
+        goto fail;
+    }
+
+    if (headless->rom_crc32 != headless->movie.header.rom_crc32)
+    {
+        error("headless", "rom crc32 0x%08x does not match movie crc32 0x%08x",
+              headless->rom_crc32, headless->movie.header.rom_crc32);
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    movie_close(&headless->movie);
+    return 1;
+}
+
+int
+headless_replay(headless_t *headless, const char *movie_path)
+{
+    uint64_t start, elapsed;
+
+    if (_headless_open_movie(headless, movie_path) != 0)
+        return 1;
+
+    notice("headless", "replaying %u frames from '%s'",
+           movie_frame_count(&headless->movie), movie_path);
+
+    start = _headless_now();
+    while (!movie_eof(&headless->movie))
+    {
+        headless->joypad_state = movie_pull(&headless->movie);
+        headless->core.api.retro_run();
+        headless->frame++;
+    }
+    elapsed = _headless_now() - start;
+
+    notice("headless", "replayed %u frames in %.3f s (%.1f fps)",
+           headless->frame, elapsed / 1e9, headless->frame / (elapsed / 1e9));
+
+    movie_close(&headless->movie);
+    return 0;
+}
+
+static int
+_headless_compare_ns(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+    return (va > vb) - (va < vb);
+}
+
+static void
+_headless_report(headless_t *headless, uint64_t *frame_ns, uint32_t frames, uint64_t elapsed)
+{
+    headless_stats_t *stats = &headless->stats;
+
+    qsort(frame_ns, frames, sizeof(uint64_t), _headless_compare_ns);
+
+    notice("headless", "core: %s %s", headless->core.name, headless->core.version);
+    notice("headless", "frames: %u in %.3f s, %.1f fps",
+           frames, elapsed / 1e9, frames / (elapsed / 1e9));
+    notice("headless", "frame time: p50 %.3f ms, p99 %.3f ms, max %.3f ms",
+           frame_ns[frames / 2] / 1e6,
+           frame_ns[(uint64_t)frames * 99 / 100] / 1e6,
+           frame_ns[frames - 1] / 1e6);
+    notice("headless", "video callback: %.3f ms total, %.3f us/frame (%u calls)",
+           stats->video_ns / 1e6, stats->video_ns / 1e3 / frames, stats->video_calls);
+    notice("headless", "audio callback: %.3f ms total, %.3f us/frame (%u calls)",
+           stats->audio_ns / 1e6, stats->audio_ns / 1e3 / frames, stats->audio_calls);
+    notice("headless", "input callback: %.3f ms total, %.3f us/frame (%u calls)",
+           stats->input_ns / 1e6, stats->input_ns / 1e3 / frames, stats->input_calls);
+}
+
+int
+headless_bench(headless_t *headless, uint32_t frames, const char *movie_path)
+{
+    uint32_t i;
+    uint64_t start, frame_start, elapsed;
+    uint64_t *frame_ns;
+
+    if (frames == 0)
+        return 1;
+
+    if (movie_path && _headless_open_movie(headless, movie_path) != 0)
+        return 1;
+
+    frame_ns = malloc(frames * sizeof(uint64_t));
+    if (frame_ns == NULL)
+        goto fail;
+
+    memset(&headless->stats, 0, sizeof(headless_stats_t));
+
+    notice("headless", "benchmarking %u frames", frames);
+
+    start = _headless_now();
+    for (i = 0; i < frames; i++)
+    {
+        if (movie_path)
+            headless->joypad_state = movie_pull(&headless->movie);
+
+        frame_start = _headless_now();
+        headless->core.api.retro_run();
+        frame_ns[i] = _headless_now() - frame_start;
+        headless->frame++;
+    }
+    elapsed = _headless_now() - start;
+
+    _headless_report(headless, frame_ns, frames, elapsed);
+
+    free(frame_ns);
+    if (movie_path)
+        movie_close(&headless->movie);
+    return 0;
+
+fail:
+    if (movie_path)
+        movie_close(&headless->movie);
+    return 1;
+}
+
+int
+headless_bench_rewind(headless_t *headless, uint32_t frames, uint32_t interval, const char *movie_path)
+{
+    uint32_t i, steps;
+    uint64_t start, elapsed;
+    rewind_t *rewind;
+
+    if (frames == 0)
+        return 1;
+
+    rewind = malloc(sizeof(rewind_t));
+    if (rewind == NULL)
+        return 1;
+
+    if (rewind_init(rewind, &headless->core, HEADLESS_REWIND_BUDGET, interval) != 0)
+    {
+        error("headless", "core %s does not support serialization", headless->core.name);
+        free(rewind);
+        return 1;
+    }
+
+    if (movie_path && _headless_open_movie(headless, movie_path) != 0)
+    {
+        rewind_deinit(rewind);
+        free(rewind);
+        return 1;
+    }
+
+    notice("headless", "benchmarking rewind capture over %u frames", frames);
+
+    for (i = 0; i < frames; i++)
+    {
+        if (movie_path)
+            headless->joypad_state = movie_pull(&headless->movie);
+
+        headless->core.api.retro_run();
+        rewind_frame(rewind);
+        headless->frame++;
+    }
+
+    rewind_report(rewind);
+
+    /* measure restore cost by stepping back through the held states */
+    steps = rewind->count;
+    start = _headless_now();
+    for (i = 0; i < steps; i++)
+    {
+        if (rewind_step_back(rewind) != 0)
+            break;
+    }
+    elapsed = _headless_now() - start;
+
+    if (i > 0)
+        notice("headless", "restored %u states, %.3f ms average", i, elapsed / 1e6 / i);
+
+    if (movie_path)
+        movie_close(&headless->movie);
+    rewind_deinit(rewind);
+    free(rewind);
+    return 0;
+}
+
+/* scripted input used when no movie is given, reproducible between runs */
+static uint16_t
+_headless_script_input(uint32_t frame, uint32_t *seed, uint16_t state)
+{
+    /* hold each combination for a few frames like a player would */
+    if ((frame % 8) == 0)
+    {
+        *seed = *seed * 1103515245u + 12345u;
+        state = (*seed >> 16) & 0x0fff;
+    }
+
+    return state;
+}
+
+static int
+_headless_trace(const char *core_path, const char *rom_path, uint32_t frames,
+                const char *movie_path, headless_trace_t *trace)
+{
+    headless_t *headless;
+    uint8_t *state = NULL;
+    size_t state_size;
+    uint32_t i, seed;
+    int res = 1;
+
+    headless = malloc(sizeof(headless_t));
+    if (headless == NULL)
+        return 1;
+
+    if (headless_init(headless, core_path, rom_path) != 0)
+    {
+        free(headless);
+        return 1;
+    }
+
+    if (movie_path && _headless_open_movie(headless, movie_path) != 0)
+        goto out;
+
+    headless->hash_video = true;
+
+    state_size = headless->core.api.retro_serialize_size();
+    if (state_size == 0)
+        warning("headless", "core %s does not support serialization, only video is verified",
+                headless->core.name);
+    else if ((state = malloc(state_size)) == NULL)
+        goto out;
+
+    seed = HEADLESS_VERIFY_SEED;
+    for (i = 0; i < frames; i++)
+    {
+        if (movie_path)
+            headless->joypad_state = movie_pull(&headless->movie);
+        else
+            headless->joypad_state = _headless_script_input(i, &seed, headless->joypad_state);
+
+        headless->core.api.retro_run();
+        headless->frame++;
+
+        trace[i].state = 0;
+        if (state && headless->core.api.retro_serialize(state, state_size))
+            trace[i].state = hash64(state, state_size, 0);
+        trace[i].video = headless->video_hash;
+    }
+
+    res = 0;
+
+out:
+    if (movie_path)
+        movie_close(&headless->movie);
+    free(state);
+    headless_deinit(headless);
+    free(headless);
+    return res;
+}
+
+static int
+_headless_report_divergence(const char *what, uint32_t frame,
+                            const headless_trace_t *a, const headless_trace_t *b)
+{
+    error("headless", "%s diverged at frame %u: state %016llx/%016llx, video %016llx/%016llx",
+          what, frame,
+          (unsigned long long)a->state, (unsigned long long)b->state,
+          (unsigned long long)a->video, (unsigned long long)b->video);
+    return 1;
+}
+
+static int
+_headless_compare_traces(const char *what, const headless_trace_t *a,
+                         const headless_trace_t *b, uint32_t frames)
+{
+    uint32_t i;
+
+    for (i = 0; i < frames; i++)
+    {
+        if (a[i].state != b[i].state || a[i].video != b[i].video)
+            return _headless_report_divergence(what, i, &a[i], &b[i]);
+    }
+
+    return 0;
+}
+
+static int
+_headless_write_golden(const char *golden_path, const headless_trace_t *trace, uint32_t frames)
+{
+    FILE *fp;
+    uint32_t i;
+
+    fp = fopen(golden_path, "w");
+    if (fp == NULL)
+    {
+        error("headless", "failed to create golden file '%s'", golden_path);
+        return 1;
+    }
+
+    for (i = 0; i < frames; i++)
+        fprintf(fp, "%u %016llx %016llx\n", i,
+                (unsigned long long)trace[i].state,
+                (unsigned long long)trace[i].video);
+
+    fclose(fp);
+    notice("headless", "wrote %u frame hashes to golden file '%s'", frames, golden_path);
+    return 0;
+}
+
+static int
+_headless_check_golden(const char *golden_path, const headless_trace_t *trace, uint32_t frames)
+{
+    FILE *fp;
+    headless_trace_t golden;
+    unsigned long long state, video;
+    unsigned frame;
+    uint32_t i;
+    int res;
+
+    fp = fopen(golden_path, "r");
+    if (fp == NULL)
+        return _headless_write_golden(golden_path, trace, frames);
+
+    res = 0;
+    for (i = 0; i < frames; i++)
+    {
+        if (fscanf(fp, "%u %llx %llx", &frame, &state, &video) != 3 || frame != i)
+        {
+            error("headless", "golden file '%s' ends or is malformed at frame %u", golden_path, i);
+            res = 1;
+            break;
+        }
+
+        golden.state = state;
+        golden.video = video;
+        if (golden.state != trace[i].state || golden.video != trace[i].video)
+        {
+            res = _headless_report_divergence("golden", i, &golden, &trace[i]);
+            break;
+        }
+    }
+
+    if (res == 0)
+        notice("headless", "matched golden file '%s'", golden_path);
+
+    fclose(fp);
+    return res;
+}
+
+int
+headless_verify(const char *core_path, const char *rom_path, uint32_t frames,
+                const char *movie_path, const char *golden_path)
+{
+    headless_trace_t *first, *second;
+    movie_t movie;
+    int res = 1;
+
+    /* a movie decides the frame count by itself */
+    if (movie_path)
+    {
+        if (movie_open(&movie, movie_path) != 0)
+        {
+            error("headless", "failed to open movie '%s'", movie_path);
+            return 1;
+        }
+        frames = movie_frame_count(&movie);
+        movie_close(&movie);
+    }
+
+    if (frames == 0)
+        return 1;
+
+    first = calloc(frames, sizeof(headless_trace_t));
+    second = calloc(frames, sizeof(headless_trace_t));
+    if (first == NULL || second == NULL)
+        goto out;
+
+    notice("headless", "verifying determinism over %u frames of %s input",
+           frames, movie_path ? "recorded" : "scripted");
+
+    /* two independent runs, each with a freshly loaded core library so
+       static state inside the core can not leak between them */
+    if (_headless_trace(core_path, rom_path, frames, movie_path, first) != 0)
+        goto out;
+    if (_headless_trace(core_path, rom_path, frames, movie_path, second) != 0)
+        goto out;
+
+    if (_headless_compare_traces("run", first, second, frames) != 0)
+        goto out;
+
+    notice("headless", "both runs matched over %u frames", frames);
+
+    if (golden_path && _headless_check_golden(golden_path, first, frames) != 0)
+        goto out;
+
+    res = 0;
+
+out:
+    free(first);
+    free(second);
+    return res;
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _headless_h
+#define _headless_h
+
+#include "core.h"
+#include "movie.h"
+
+#define HEADLESS_AUDIO_SAMPLES 8192
+#define HEADLESS_REWIND_BUDGET (64 * 1024 * 1024)
+
+/* per frame hashes of serialized state and visible video */
+typedef struct headless_trace_t {
+    uint64_t state;
+    uint64_t video;
+} headless_trace_t;
+
+typedef struct headless_stats_t {
+    uint64_t video_ns;
+    uint64_t audio_ns;
+    uint64_t input_ns;
+    uint32_t video_calls;
+    uint32_t audio_calls;
+    uint32_t input_calls;
+} headless_stats_t;
+
+/*
+ * Headless runner, drives a core without any window, audio device or
+ * scenes. Used for replaying recorded movies, benchmarking cores and
+ * verifying determinism on the command line.
+ */
+typedef struct headless_t {
+    core_t core;
+    movie_t movie;
+    uint32_t rom_crc32;
+    uint16_t joypad_state;
+    uint32_t frame;
+
+    uint8_t *video;
+    size_t video_size;
+    unsigned pixel_size;
+    bool hash_video;
+    uint64_t video_hash;
+    int16_t audio[HEADLESS_AUDIO_SAMPLES];
+
+    headless_stats_t stats;
+} headless_t;
+
+int headless_init(headless_t *headless, const char *core_path, const char *rom_path);
+void headless_deinit(headless_t *headless);
+int headless_replay(headless_t *headless, const char *movie_path);
+int headless_bench(headless_t *headless, uint32_t frames, const char *movie_path);
+int headless_bench_rewind(headless_t *headless, uint32_t frames, uint32_t interval,
+                          const char *movie_path);
+int headless_verify(const char *core_path, const char *rom_path, uint32_t frames,
+                    const char *movie_path, const char *golden_path);
+
+#endif /* _headless_h */
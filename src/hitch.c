@@ -0,0 +1,172 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <memory.h>
+
+#include "logger.h"
+#include "hitch.h"
+
+static const char *_hitch_phase_names[PROFILER_PHASES] = {
+    "run",
+    "upload",
+    "render",
+    "present",
+    "audio",
+    "idle",
+};
+
+int
+hitch_init(hitch_t *hitch, uint32_t budget_ms, const char *filename)
+{
+    memset(hitch, 0, sizeof(hitch_t));
+    hitch->budget_us = budget_ms * 1000;
+    snprintf(hitch->filename, sizeof(hitch->filename), "%s", filename);
+    return 0;
+}
+
+void
+hitch_arm(hitch_t *hitch, bool armed)
+{
+    hitch->armed = armed;
+    hitch->pending = false;
+
+    /* the frame in progress may contain scene setup, skip it */
+    hitch->arm_frame = hitch->frame;
+}
+
+static void
+_hitch_printf(hitch_t *hitch, const char *fmt, ...)
+{
+    int len;
+    va_list ap;
+
+    va_start(ap, fmt);
+    len = vsnprintf(hitch->dump + hitch->dump_len,
+                    sizeof(hitch->dump) - hitch->dump_len, fmt, ap);
+    va_end(ap);
+
+    /* a truncated window keeps whatever fit */
+    if (len > 0)
+        hitch->dump_len += len;
+    if (hitch->dump_len >= sizeof(hitch->dump))
+        hitch->dump_len = sizeof(hitch->dump) - 1;
+}
+
+/*
+ * Runs on the main thread, the window is formatted into one buffer
+ * and written with a single write instead of a syscall per field.
+ */
+static void
+_hitch_dump(hitch_t *hitch)
+{
+    int i, fd;
+    uint32_t first, frame;
+    time_t now;
+    char date[64];
+    hitch_record_t *record;
+
+    fd = open(hitch->filename, O_CREAT | O_APPEND | O_WRONLY, 0644);
+    if (fd < 0)
+    {
+        warning("hitch", "failed to open hitch log '%s'", hitch->filename);
+        return;
+    }
+
+    hitch->dump_len = 0;
+
+    now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    _hitch_printf(hitch, "# hitch at frame %u, %s, budget %u us\n",
+                  hitch->hitch_frame, date, hitch->budget_us);
+
+    _hitch_printf(hitch, "# frame total");
+    for (i = 0; i < PROFILER_PHASES; i++)
+        _hitch_printf(hitch, " %s", _hitch_phase_names[i]);
+    _hitch_printf(hitch, " audio_fill events\n");
+
+    first = hitch->hitch_frame > HITCH_WINDOW / 2 ? hitch->hitch_frame - HITCH_WINDOW / 2 : 0;
+    for (frame = first; frame < hitch->frame; frame++)
+    {
+        record = &hitch->records[frame % HITCH_RECORDS];
+        if (record->frame != frame)
+            continue;
+
+        _hitch_printf(hitch, "%s%u %u", frame == hitch->hitch_frame ? "*" : "",
+                      record->frame, record->total_us);
+        for (i = 0; i < PROFILER_PHASES; i++)
+            _hitch_printf(hitch, " %u", record->phase_us[i]);
+        _hitch_printf(hitch, " %d %u\n", record->audio_fill, record->events);
+    }
+
+    if (write(fd, hitch->dump, hitch->dump_len) != (ssize_t)hitch->dump_len)
+        warning("hitch", "failed to write hitch log '%s'", hitch->filename);
+
+    close(fd);
+    notice("hitch", "frame %u exceeded %u us budget, window written to '%s'",
+           hitch->hitch_frame, hitch->budget_us, hitch->filename);
+}
+
+/*
+ * Record last completed profiler frame, called once per frame so it
+ * must stay cheap and never allocate.
+ */
+void
+hitch_record(hitch_t *hitch, profiler_t *profiler)
+{
+    int i;
+    hitch_record_t *record;
+
+    record = &hitch->records[hitch->frame % HITCH_RECORDS];
+    record->frame = hitch->frame;
+    record->total_us = profiler->last_total * 1000000 / profiler->frequency;
+    for (i = 0; i < PROFILER_PHASES; i++)
+        record->phase_us[i] = profiler->last_ticks[i] * 1000000 / profiler->frequency;
+    record->audio_fill = profiler->last_audio_fill;
+    record->events = profiler->last_events;
+
+    /* the frame that wrote a dump is slow because of it, not the game */
+    if (hitch->armed && !hitch->pending && hitch->frame > hitch->arm_frame
+        && (hitch->dumps == 0 || hitch->frame != hitch->dump_frame)
+        && record->total_us > hitch->budget_us)
+    {
+        hitch->pending = true;
+        hitch->hitch_frame = hitch->frame;
+        hitch->hitches++;
+    }
+
+    hitch->frame++;
+
+    /* dump once the frames following the hitch are recorded too */
+    if (hitch->pending && hitch->frame >= hitch->hitch_frame + HITCH_WINDOW / 2)
+    {
+        hitch->pending = false;
+        _hitch_dump(hitch);
+
+        /* the dump runs inside the frame that is recorded next */
+        hitch->dump_frame = hitch->frame;
+        hitch->dumps++;
+    }
+}
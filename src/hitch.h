@@ -0,0 +1,68 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _hitch_h
+#define _hitch_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "profiler.h"
+
+#define HITCH_RECORDS 4096
+#define HITCH_WINDOW 240
+
+/* one formatted window, about 60 bytes per frame */
+#define HITCH_DUMP_SIZE (HITCH_WINDOW * 128)
+
+typedef struct hitch_record_t {
+    uint32_t frame;
+    uint32_t total_us;
+    uint32_t phase_us[PROFILER_PHASES];
+    int32_t audio_fill;
+    uint32_t events;
+} hitch_record_t;
+
+/*
+ * Hitch recorder, keeps a ring of the latest frame records and dumps
+ * the window around any frame exceeding the budget to a log file.
+ */
+typedef struct hitch_t {
+    hitch_record_t records[HITCH_RECORDS];
+    uint32_t frame;
+    uint32_t budget_us;
+    bool armed;
+    uint32_t arm_frame;
+    bool pending;
+    uint32_t hitch_frame;
+    uint32_t dump_frame;
+    uint32_t dumps;
+    uint32_t hitches;
+    char filename[1024];
+    char dump[HITCH_DUMP_SIZE];
+    size_t dump_len;
+} hitch_t;
+
+int hitch_init(hitch_t *hitch, uint32_t budget_ms, const char *filename);
+void hitch_arm(hitch_t *hitch, bool armed);
+void hitch_record(hitch_t *hitch, profiler_t *profiler);
+
+#endif /* _hitch_h */
@@ -0,0 +1,36 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _in_game_menu_h
+#define _in_game_menu_h
+
+#include <stdbool.h>
+
+#include "scraper.h"
+
+/* opaque of in_game_menu_scene, describes the running session */
+typedef struct in_game_menu_t {
+    scraper_rom_entry_t *rom_entry;
+    /* an input movie is recorded, state jumps would break its replay */
+    bool recording;
+} in_game_menu_t;
+
+#endif /* _in_game_menu_h */
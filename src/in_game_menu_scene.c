@@ -20,7 +20,7 @@
  */
 
 #include <stdio.h>
-#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <SDL_ttf.h>
@@ -28,13 +28,15 @@
 #include "logger.h"
 #include "scene.h"
 #include "engine.h"
+#include "in_game_menu.h"
 #include "draw.h"
 
 #define MENU_ITEMS 8
+#define STATE_SLOTS_MAX 10
 
 typedef struct menu_item_t {
     uint8_t id;
-    char label[32];
+    char label[48];
     int (*on_menu_item)(struct menu_item_t *item, struct scene_t *scene);
 } menu_item_t;
 
@@ -44,84 +46,193 @@ enum {
     GAME_RESTART,
     GAME_LOAD,
     GAME_SAVE,
+    GAME_SLOT,
     MENU_ENTRIES,
 };
 
 typedef struct {
     bool dirty;
     core_t *core;
+    scraper_rom_entry_t *rom_entry;
     int32_t index;
     menu_item_t *menu;
     uint8_t menu_item_cnt;
+
+    /* save state slots of the running rom */
+    int slot;
+    int slot_cnt;
+    scraper_state_entry_t states[STATE_SLOTS_MAX + 1];
+    size_t state_cnt;
+
+    /* the running session records an input movie */
+    bool recording;
 } in_game_menu_scene_data_t;
 
-static int
-_in_game_menu_save_game(struct scene_t *scene, const char *filename)
+static menu_item_t *
+_in_game_menu_find_item(in_game_menu_scene_data_t *data, uint8_t id)
 {
-    int fd = -1;
-    uint8_t *state;
-    size_t size;
+    int i;
+    for (i = 0; i < data->menu_item_cnt; i++)
+    {
+        if (data->menu[i].id == id)
+            return &data->menu[i];
+    }
+    return NULL;
+}
+
+static scraper_state_entry_t *
+_in_game_menu_find_state(in_game_menu_scene_data_t *data, int slot)
+{
+    size_t i;
+    for (i = 0; i < data->state_cnt; i++)
+    {
+        if (data->states[i].slot == slot)
+            return &data->states[i];
+    }
+    return NULL;
+}
+
+static void
+_in_game_menu_update_slot(struct scene_t *scene)
+{
+    char date[32];
+    menu_item_t *item;
+    scraper_state_entry_t *state;
     in_game_menu_scene_data_t *data = scene->opaque;
 
-    size = data->core->api.retro_serialize_size();
+    item = _in_game_menu_find_item(data, GAME_SLOT);
+    state = _in_game_menu_find_state(data, data->slot);
 
-    state = malloc(size);
-    if (!data->core->api.retro_serialize(state, size))
-        goto fail;
+    if (state == NULL)
+    {
+        snprintf(item->label, sizeof(item->label), "< Slot %d: empty >", data->slot + 1);
+    }
+    else
+    {
+        time_t timestamp = state->timestamp;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&timestamp));
+        snprintf(item->label, sizeof(item->label), "< Slot %d: %s >", data->slot + 1, date);
+    }
+
+    data->dirty = true;
+}
+
+/*
+ * Slots are indexed when a save is queued, a write that failed on the
+ * writer thread leaves a row without a file so only slots whose file
+ * exists or is still being written are listed, without waiting for
+ * the writer.
+ */
+static void
+_in_game_menu_load_states(struct scene_t *scene)
+{
+    size_t i, cnt;
+    char path[4096];
+    in_game_menu_scene_data_t *data = scene->opaque;
 
+    /* room for the suspend state which is not listed */
+    cnt = STATE_SLOTS_MAX + 1;
+    if (scraper_get_states(&scene->engine->scraper, data->rom_entry->path,
+                           data->states, &cnt) != 0)
+        cnt = 0;
 
-    /* store serialize data to disk */
-    fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
-    if (fd < 0)
-        goto fail;
+    data->state_cnt = 0;
+    for (i = 0; i < cnt; i++)
+    {
+        if (data->states[i].slot == SAVESTATE_SLOT_AUTO)
+            continue;
 
-    if (write(fd, state, size) != size)
-        goto fail;
+        savestate_path(path, sizeof(path),
+                       config_get(&scene->engine->config, "/hjortron/directories/states", "/tmp"),
+                       data->rom_entry->path, data->states[i].slot);
 
-    close(fd);
-    free(state);
-    return 0;
+        /* a write still in flight finishes before it stops counting */
+        if (!savestate_writing(&scene->engine->savestate, path)
+            && access(path, R_OK) != 0)
+        {
+            warning("in_game_menu_scene", "state in slot %d has no file '%s'",
+                    data->states[i].slot + 1, path);
+            continue;
+        }
 
-fail:
-    if (fd > 0)
-        close(fd);
+        data->states[data->state_cnt++] = data->states[i];
+    }
 
-    free(state);
-    return 1;
+    _in_game_menu_update_slot(scene);
 }
 
-static int
-_in_game_menu_load_game(struct scene_t *scene, const char *filename)
+static void
+_in_game_menu_select_slot(struct scene_t *scene, int delta)
 {
-    int fd;
-    uint8_t *state;
-    off_t size;
     in_game_menu_scene_data_t *data = scene->opaque;
 
-    data->core->api.retro_reset();
+    data->slot = (data->slot + data->slot_cnt + delta) % data->slot_cnt;
+    _in_game_menu_update_slot(scene);
+}
+
+static int
+_in_game_menu_save_game(struct scene_t *scene)
+{
+    char path[4096];
+    scraper_state_entry_t state;
+    in_game_menu_scene_data_t *data = scene->opaque;
 
-    fd = open(filename, O_RDONLY);
-    if (fd < 0)
-        goto fail;
+    savestate_path(path, sizeof(path),
+                   config_get(&scene->engine->config, "/hjortron/directories/states", "/tmp"),
+                   data->rom_entry->path, data->slot);
 
-    size = lseek(fd, 0, SEEK_END);
-    state = malloc(size);
+    memset(&state, 0, sizeof(state));
+    state.slot = data->slot;
+    state.timestamp = time(NULL);
+    state.size = data->core->api.retro_serialize_size();
+    snprintf(state.core, sizeof(state.core), "%s", data->core->name);
+    snprintf(state.core_version, sizeof(state.core_version), "%s", data->core->version);
 
-    lseek(fd, 0, SEEK_SET);
-    if (read(fd, state, size) != size)
-        goto fail;
+    if (savestate_save(&scene->engine->savestate, data->core, path) != 0)
+        return 1;
 
-    if (!data->core->api.retro_unserialize(state, size))
-        goto fail;
+    if (scraper_put_state(&scene->engine->scraper, data->rom_entry->path, &state) != 0)
+        warning("in_game_menu_scene", "failed to index state '%s'", path);
 
-    close(fd);
-    free(state);
+    /* the menu is left after saving, states are reloaded on the next mount */
     return 0;
-fail:
-    if (fd > 0)
-        close(fd);
-    free(state);
-    return 1;
+}
+
+static int
+_in_game_menu_load_game(struct scene_t *scene)
+{
+    char path[4096];
+    scraper_state_entry_t *state;
+    in_game_menu_scene_data_t *data = scene->opaque;
+
+    /* a movie can not replay a jump to a state */
+    if (data->recording)
+    {
+        warning("in_game_menu_scene", "loading a state is disabled while recording a movie");
+        return 1;
+    }
+
+    state = _in_game_menu_find_state(data, data->slot);
+    if (state == NULL)
+        return 1;
+
+    if (strcmp(state->core, data->core->name) != 0)
+    {
+        warning("in_game_menu_scene", "state in slot %d was saved by core '%s'",
+                data->slot + 1, state->core);
+        return 1;
+    }
+
+    if (strcmp(state->core_version, data->core->version) != 0)
+        warning("in_game_menu_scene", "state in slot %d was saved by %s version %s",
+                data->slot + 1, state->core, state->core_version);
+
+    savestate_path(path, sizeof(path),
+                   config_get(&scene->engine->config, "/hjortron/directories/states", "/tmp"),
+                   data->rom_entry->path, data->slot);
+
+    data->core->api.retro_reset();
+    return savestate_load(&scene->engine->savestate, data->core, path);
 }
 
 static int
@@ -136,22 +247,30 @@ _in_game_menu_item_handler(menu_item_t *item, struct scene_t *scene)
             break;
 
         case GAME_RESTART: /* Restart game */
-            data->core->api.retro_reset();
+            /* the movie has no record of the reset */
+            if (data->recording)
+                warning("in_game_menu_scene", "restart is disabled while recording a movie");
+            else
+                data->core->api.retro_reset();
             engine_pop_scene(scene->engine);
             break;
 
         case GAME_SAVE: /* Save game */
-            if (_in_game_menu_save_game(scene, "/tmp/state.rom") != 0)
+            if (_in_game_menu_save_game(scene) != 0)
                 warning("in_game_menu_scene", "failed to save game");
             engine_pop_scene(scene->engine);
             break;
 
         case GAME_LOAD: /* Load game */
-            if (_in_game_menu_load_game(scene, "/tmp/state.rom") != 0)
+            if (_in_game_menu_load_game(scene) != 0)
                 warning("in_game_menu_scene", "failed to load game");
             engine_pop_scene(scene->engine);
             break;
 
+        case GAME_SLOT: /* Select state slot */
+            _in_game_menu_select_slot(scene, 1);
+            break;
+
         case GAME_QUIT: /* Quit game */
             engine_pop_scene(scene->engine);
             engine_pop_scene(scene->engine);
@@ -167,6 +286,7 @@ static menu_item_t _in_game_menu[] = {
     {GAME_BACK, "Back to game", _in_game_menu_item_handler},
     {GAME_QUIT, "Quit game", _in_game_menu_item_handler},
     {GAME_RESTART, "Restart game", _in_game_menu_item_handler},
+    {GAME_SLOT, "", _in_game_menu_item_handler},
     {GAME_LOAD, "Load game", _in_game_menu_item_handler},
     {GAME_SAVE, "Save game", _in_game_menu_item_handler},
 };
@@ -174,9 +294,22 @@ static menu_item_t _in_game_menu[] = {
 static int
 _in_game_menu_scene_mount(struct scene_t *scene, void *opaque)
 {
+    in_game_menu_t *menu = opaque;
     in_game_menu_scene_data_t *data = scene->opaque;
-    data->core = opaque;
+    data->rom_entry = menu->rom_entry;
+    data->recording = menu->recording;
+    data->core = core_collection_get_by_name(&scene->engine->cores, data->rom_entry->core);
     data->index = 0;
+
+    data->slot_cnt = strtoul(config_get(&scene->engine->config, "/hjortron/states/slots", "4"), NULL, 10);
+    if (data->slot_cnt < 1)
+        data->slot_cnt = 1;
+    if (data->slot_cnt > STATE_SLOTS_MAX)
+        data->slot_cnt = STATE_SLOTS_MAX;
+    if (data->slot >= data->slot_cnt)
+        data->slot = 0;
+
+    _in_game_menu_load_states(scene);
     return 0;
 }
 
@@ -294,6 +427,12 @@ _in_game_menu_scene_handle_event(struct scene_t *scene, SDL_Event *event)
                     data->index = MENU_ENTRIES - 1;
                 data->dirty = true;
                 break;
+            case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+                _in_game_menu_select_slot(scene, -1);
+                break;
+            case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+                _in_game_menu_select_slot(scene, 1);
+                break;
         }
     }
 }
@@ -301,6 +440,7 @@ _in_game_menu_scene_handle_event(struct scene_t *scene, SDL_Event *event)
 in_game_menu_scene_data_t _in_game_menu_scene_data = {
     false,
     NULL,
+    NULL,
     0,
     _in_game_menu,
     sizeof(_in_game_menu) / sizeof(menu_item_t),
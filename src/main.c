@@ -20,13 +20,226 @@
  */
 
 #include <signal.h>
+#include <time.h>
+#include <unistd.h>
 #include "engine.h"
+#include "headless.h"
+#include "crc32.h"
 
 static engine_t engine;
 
-int main()
+static int
+_main_replay(const char *core, const char *rom, const char *movie)
 {
     int res;
+    headless_t headless;
+
+    if (headless_init(&headless, core, rom) != 0)
+        return 1;
+
+    res = headless_replay(&headless, movie);
+
+    headless_deinit(&headless);
+    return res;
+}
+
+static int
+_main_bench(const char *core, const char *rom, const char *frames, const char *movie)
+{
+    int res;
+    headless_t headless;
+
+    if (headless_init(&headless, core, rom) != 0)
+        return 1;
+
+    res = headless_bench(&headless, strtoul(frames, NULL, 10), movie);
+
+    headless_deinit(&headless);
+    return res;
+}
+
+static int
+_main_bench_rewind(const char *core, const char *rom, const char *frames,
+                   const char *interval, const char *movie)
+{
+    int res;
+    headless_t headless;
+
+    if (headless_init(&headless, core, rom) != 0)
+        return 1;
+
+    res = headless_bench_rewind(&headless, strtoul(frames, NULL, 10),
+                                strtoul(interval, NULL, 10), movie);
+
+    headless_deinit(&headless);
+    return res;
+}
+
+static int
+_main_verify(const char *core, const char *rom, const char *input, const char *golden)
+{
+    char *end;
+    unsigned long frames;
+
+    /* input is either a frame count of scripted input or a movie */
+    frames = strtoul(input, &end, 10);
+    if (*input != '\0' && *end == '\0')
+        return headless_verify(core, rom, frames, NULL, golden);
+
+    return headless_verify(core, rom, 0, input, golden);
+}
+
+static int
+_main_bench_scan(const char *core_path, const char *rom_path, const char *database)
+{
+    int res = 1;
+    scraper_t scraper;
+    core_collection_t cores;
+
+    /* start from an empty database, the second pass measures a rescan */
+    unlink(database);
+
+    if (core_collection_init(&cores, core_path, "/tmp/hjortron-cores.json") != 0)
+        return 1;
+
+    if (scraper_init(&scraper, database) != 0)
+        goto out;
+
+    notice("main", "initial scan of '%s'", rom_path);
+    if (scraper_scan_directory(&scraper, &cores, rom_path) != 0)
+        goto fail;
+
+    notice("main", "rescan of '%s'", rom_path);
+    if (scraper_scan_directory(&scraper, &cores, rom_path) != 0)
+        goto fail;
+
+    res = 0;
+
+fail:
+    scraper_deinit(&scraper);
+out:
+    core_collection_deinit(&cores);
+    return res;
+}
+
+static int
+_main_bench_crc(const char *megabytes)
+{
+    return crc32_bench(strtoul(megabytes, NULL, 10) << 20);
+}
+
+static int
+_main_import_dat(const char *database, int count, char **dats)
+{
+    int i, res = 0;
+    scraper_t scraper;
+
+    if (scraper_init(&scraper, database) != 0)
+        return 1;
+
+    for (i = 0; i < count; i++)
+        res |= scraper_import_dat(&scraper, dats[i]);
+
+    scraper_deinit(&scraper);
+    return res;
+}
+
+/* search each prefix of text, as when it is typed one key at a time */
+static int
+_main_bench_search(const char *database, const char *text)
+{
+    size_t i, j, size, interrupted = 0;
+    char prefix[256];
+    struct timespec start, end;
+    double elapsed, slowest = 0.0;
+    scraper_rom_entry_t result[8];
+    scraper_t scraper;
+
+    if (scraper_init(&scraper, database) != 0)
+        return 1;
+
+    for (i = 1; i <= strlen(text) && i < sizeof(prefix); i++)
+    {
+        snprintf(prefix, i + 1, "%s", text);
+
+        size = sizeof(result) / sizeof(result[0]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (scraper_search(&scraper, prefix, size, result, &size) != 0)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+        /* an interrupted search only shows the budget, not its real cost */
+        if (scraper.search_interrupted)
+        {
+            interrupted++;
+            notice("main", "search '%s': interrupted after %.2f ms", prefix, elapsed);
+        }
+        else
+        {
+            if (elapsed > slowest)
+                slowest = elapsed;
+            notice("main", "search '%s': %zu results in %.2f ms", prefix, size, elapsed);
+        }
+
+        for (j = 0; j < size; j++)
+        {
+            free((void *)result[j].path);
+            free((void *)result[j].name);
+            free((void *)result[j].core);
+            free((void *)result[j].key);
+        }
+    }
+
+    notice("main", "slowest completed search %.2f ms, %zu interrupted", slowest, interrupted);
+
+    scraper_deinit(&scraper);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int res;
+
+    if (argc > 1)
+    {
+        if (argc == 5 && strcmp(argv[1], "--replay") == 0)
+            exit(_main_replay(argv[2], argv[3], argv[4]));
+
+        if ((argc == 5 || argc == 6) && strcmp(argv[1], "--bench") == 0)
+            exit(_main_bench(argv[2], argv[3], argv[4], argc == 6 ? argv[5] : NULL));
+
+        if ((argc == 6 || argc == 7) && strcmp(argv[1], "--bench-rewind") == 0)
+            exit(_main_bench_rewind(argv[2], argv[3], argv[4], argv[5], argc == 7 ? argv[6] : NULL));
+
+        if ((argc == 5 || argc == 6) && strcmp(argv[1], "--verify") == 0)
+            exit(_main_verify(argv[2], argv[3], argv[4], argc == 6 ? argv[5] : NULL));
+
+        if ((argc == 4 || argc == 5) && strcmp(argv[1], "--bench-scan") == 0)
+            exit(_main_bench_scan(argv[2], argv[3], argc == 5 ? argv[4] : "/tmp/hjortron-bench.db"));
+
+        if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench-crc") == 0)
+            exit(_main_bench_crc(argc == 3 ? argv[2] : "64"));
+
+        if (argc >= 4 && strcmp(argv[1], "--import-dat") == 0)
+            exit(_main_import_dat(argv[2], argc - 3, argv + 3));
+
+        if (argc == 4 && strcmp(argv[1], "--bench-search") == 0)
+            exit(_main_bench_search(argv[2], argv[3]));
+
+        fprintf(stderr, "usage: %s [--replay core rom movie]\n"
+                        "       %s [--bench core rom frames [movie]]\n"
+                        "       %s [--bench-rewind core rom frames interval [movie]]\n"
+                        "       %s [--verify core rom movie|frames [golden]]\n"
+                        "       %s [--bench-scan cores roms [database]]\n"
+                        "       %s [--bench-crc [megabytes]]\n"
+                        "       %s [--import-dat database dat...]\n"
+                        "       %s [--bench-search database text]\n",
+                        argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        exit(1);
+    }
+
     if(engine_init(&engine) != 0)
     {
         error("main", "an error occured, exiting...");
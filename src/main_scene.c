@@ -32,7 +32,9 @@ static int MENU_BAR_ITEM_SIZE = 0;
 #define ROM_ENTRIES 8
 
 extern scene_t run_game_scene;
-static char *menu_bar_items = "abcdefghijklmnopqrstuvwxyz";
+extern scene_t search_scene;
+/* one item per scraper bucket: digits and symbols, a-z, everything else */
+static char *menu_bar_items = "#abcdefghijklmnopqrstuvwxyz*";
 
 
 typedef struct {
@@ -41,8 +43,8 @@ typedef struct {
     struct {
         scraper_rom_entry_t entries[ROM_ENTRIES];
         size_t entry_cnt;
-        int32_t offset;
         int32_t index;
+        uint32_t generation;
     } menu_roms;
 
     struct {
@@ -54,31 +56,180 @@ typedef struct {
 
 } main_scene_data_t;
 
-static int
-_main_scene_update_rom_entries(scene_t *scene)
+static void
+_main_scene_free_rom_entries(scraper_rom_entry_t *entries)
 {
     int i;
-    main_scene_data_t *data = scene->opaque;
 
-    /* free up entries */
     for (i = 0; i < ROM_ENTRIES; i++)
     {
-        free((void *)data->menu_roms.entries[i].name);
-        free((void *)data->menu_roms.entries[i].path);
-        free((void *)data->menu_roms.entries[i].core);
+        free((void *)entries[i].name);
+        free((void *)entries[i].path);
+        free((void *)entries[i].core);
+        free((void *)entries[i].key);
     }
 
-    memset(&data->menu_roms.entries, 0, sizeof(data->menu_roms.entries));
-    data->menu_roms.entry_cnt = ROM_ENTRIES;
+    memset(entries, 0, sizeof(scraper_rom_entry_t) * ROM_ENTRIES);
+}
+
+static void
+_main_scene_set_rom_entries(main_scene_data_t *data, scraper_rom_entry_t *entries, size_t count)
+{
+    _main_scene_free_rom_entries(data->menu_roms.entries);
+    memcpy(data->menu_roms.entries, entries, sizeof(scraper_rom_entry_t) * ROM_ENTRIES);
+    data->menu_roms.entry_cnt = count;
 
-    /* get new entries */
-    if (scraper_get_list(&scene->engine->scraper, data->menu_roms.offset, ROM_ENTRIES,
-        data->menu_roms.entries, &data->menu_roms.entry_cnt) != 0)
-        data->menu_roms.entry_cnt = 0;
+    if (data->menu_roms.index >= (int32_t)count)
+        data->menu_roms.index = count ? count - 1 : 0;
+}
 
+/*
+ * Show the page starting at the row (key, path), pages are fetched by
+ * key so scrolling costs the same anywhere in the library.
+ */
+static int
+_main_scene_update_rom_entries(scene_t *scene, const char *key, const char *path)
+{
+    size_t count = ROM_ENTRIES;
+    scraper_rom_entry_t entries[ROM_ENTRIES] = {0};
+    main_scene_data_t *data = scene->opaque;
+
+    data->menu_roms.generation = scene->engine->scraper.generation;
+
+    /* key and path may point into the current page */
+    if (scraper_get_from(&scene->engine->scraper, key, path, ROM_ENTRIES, entries, &count) != 0)
+        count = 0;
+
+    _main_scene_set_rom_entries(data, entries, count);
     return 0;
 }
 
+/* move the page one row down, false at the end of the list */
+static bool
+_main_scene_scroll_down(scene_t *scene)
+{
+    size_t count = ROM_ENTRIES;
+    scraper_rom_entry_t entries[ROM_ENTRIES] = {0};
+    main_scene_data_t *data = scene->opaque;
+
+    if (data->menu_roms.entry_cnt < ROM_ENTRIES)
+        return false;
+
+    if (scraper_get_from(&scene->engine->scraper, data->menu_roms.entries[1].key,
+                         data->menu_roms.entries[1].path, ROM_ENTRIES, entries, &count) != 0
+        || count < ROM_ENTRIES)
+    {
+        _main_scene_free_rom_entries(entries);
+        return false;
+    }
+
+    _main_scene_set_rom_entries(data, entries, count);
+    return true;
+}
+
+/* move the page one row up, false at the start of the list */
+static bool
+_main_scene_scroll_up(scene_t *scene)
+{
+    size_t count = 1;
+    scraper_rom_entry_t prev[ROM_ENTRIES] = {0};
+    main_scene_data_t *data = scene->opaque;
+
+    if (data->menu_roms.entry_cnt == 0)
+        return false;
+
+    if (scraper_get_before(&scene->engine->scraper, data->menu_roms.entries[0].key,
+                           data->menu_roms.entries[0].path, 1, prev, &count) != 0
+        || count == 0)
+        return false;
+
+    _main_scene_update_rom_entries(scene, prev[0].key, prev[0].path);
+    _main_scene_free_rom_entries(prev);
+    return true;
+}
+
+static bool
+_main_scene_same_entry(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+    return strcmp(a, b) == 0;
+}
+
+/*
+ * The rom library changed on disk, refetch the visible page and only
+ * redraw when its entries actually differ.
+ */
+static void
+_main_scene_refresh_rom_entries(scene_t *scene)
+{
+    size_t i, count = ROM_ENTRIES;
+    scraper_rom_entry_t entries[ROM_ENTRIES] = {0};
+    main_scene_data_t *data = scene->opaque;
+
+    data->menu_roms.generation = scene->engine->scraper.generation;
+
+    if (scraper_get_from(&scene->engine->scraper,
+                         data->menu_roms.entry_cnt ? data->menu_roms.entries[0].key : "",
+                         data->menu_roms.entry_cnt ? data->menu_roms.entries[0].path : "",
+                         ROM_ENTRIES, entries, &count) != 0)
+        return;
+
+    if (count == data->menu_roms.entry_cnt)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!_main_scene_same_entry(entries[i].path, data->menu_roms.entries[i].path)
+                || !_main_scene_same_entry(entries[i].name, data->menu_roms.entries[i].name)
+                || !_main_scene_same_entry(entries[i].core, data->menu_roms.entries[i].core))
+                break;
+        }
+
+        if (i == count)
+        {
+            _main_scene_free_rom_entries(entries);
+            return;
+        }
+    }
+
+    _main_scene_set_rom_entries(data, entries, count);
+    data->dirty = true;
+}
+
+/* keep the menu bar on the bucket of the selected rom */
+static void
+_main_scene_sync_menu_bar(struct scene_t *scene)
+{
+    main_scene_data_t *data = scene->opaque;
+
+    if (data->menu_roms.entry_cnt == 0)
+        return;
+
+    data->menu_bar.index = scraper_bucket_of(data->menu_roms.entries[data->menu_roms.index].key);
+}
+
+/* jump to the first rom of the selected bucket, or of the next non empty one */
+static void
+_main_scene_jump_to_bucket(struct scene_t *scene)
+{
+    int32_t bucket;
+    const scraper_bucket_t *buckets;
+    main_scene_data_t *data = scene->opaque;
+
+    buckets = scraper_get_buckets(&scene->engine->scraper);
+
+    for (bucket = data->menu_bar.index; bucket < SCRAPER_BUCKETS; bucket++)
+    {
+        if (buckets[bucket].count == 0)
+            continue;
+
+        _main_scene_update_rom_entries(scene, buckets[bucket].key, "");
+        data->menu_roms.index = 0;
+        data->menu_bar.index = bucket;
+        return;
+    }
+}
+
 static void
 _main_scene_side_menu_bar_texture(struct scene_t *scene)
 {
@@ -89,7 +240,7 @@ _main_scene_side_menu_bar_texture(struct scene_t *scene)
     main_scene_data_t *data = scene->opaque;
 
     menu_bar = SDL_CreateRGBSurfaceWithFormat(0, MENU_BAR_ITEM_SIZE,
-                                              MENU_BAR_ITEM_SIZE * (27 + 1),
+                                              MENU_BAR_ITEM_SIZE * (SCRAPER_BUCKETS + 1),
                                               32, SDL_PIXELFORMAT_RGBA32);
 
     dest.x = dest.y = 0;
@@ -132,8 +283,8 @@ _main_scene_mount(struct scene_t *scene, void *opaque)
     _main_scene_side_menu_bar_texture(scene);
 
     /* fetch first set of available roms */
-    data->menu_roms.index = data->menu_roms.offset = 0;
-    _main_scene_update_rom_entries(scene);
+    data->menu_roms.index = 0;
+    _main_scene_update_rom_entries(scene, "", "");
 
     return 0;
 }
@@ -245,6 +396,9 @@ _main_scene_tick(struct scene_t *scene)
 {
     main_scene_data_t *data = scene->opaque;
 
+    if (data->menu_roms.generation != scene->engine->scraper.generation)
+        _main_scene_refresh_rom_entries(scene);
+
     if (data->dirty == false)
     {
         SDL_Delay(25);
@@ -258,7 +412,6 @@ _main_scene_tick(struct scene_t *scene)
 static void
 _main_scene_handle_event(struct scene_t *scene, SDL_Event *event)
 {
-    char rom_ch;
     main_scene_data_t *data = scene->opaque;
 
     if (event->type == SDL_CONTROLLERBUTTONDOWN)
@@ -274,13 +427,11 @@ _main_scene_handle_event(struct scene_t *scene, SDL_Event *event)
                     data->menu_roms.index--;
                     if (data->menu_roms.index < 0)
                     {
-                        data->menu_roms.offset--;
                         data->menu_roms.index = 0;
-                        _main_scene_update_rom_entries(scene);
+                        _main_scene_scroll_up(scene);
                     }
 
-                    rom_ch = tolower(data->menu_roms.entries[data->menu_roms.index].name[0]);
-                    data->menu_bar.index = rom_ch - 'a';
+                    _main_scene_sync_menu_bar(scene);
                 }
                 else
                 {
@@ -297,19 +448,17 @@ _main_scene_handle_event(struct scene_t *scene, SDL_Event *event)
                         break;
 
                     data->menu_roms.index++;
-                    if (data->menu_roms.index >= ROM_ENTRIES)
+                    if (data->menu_roms.index >= (int32_t)data->menu_roms.entry_cnt)
                     {
-                        data->menu_roms.offset++;
-                        data->menu_roms.index = ROM_ENTRIES - 1;
-                        _main_scene_update_rom_entries(scene);
+                        data->menu_roms.index = data->menu_roms.entry_cnt - 1;
+                        _main_scene_scroll_down(scene);
                     }
 
-                    rom_ch = tolower(data->menu_roms.entries[data->menu_roms.index].name[0]);
-                    data->menu_bar.index = rom_ch - 'a';
+                    _main_scene_sync_menu_bar(scene);
                 }
                 else
                 {
-                    if (data->menu_bar.index < 25)
+                    if (data->menu_bar.index < SCRAPER_BUCKETS - 1)
                         data->menu_bar.index++;
                 }
                 data->dirty = true;
@@ -336,15 +485,17 @@ _main_scene_handle_event(struct scene_t *scene, SDL_Event *event)
                 }
                 else
                 {
-                    /* jump to char */
-                    data->menu_roms.offset =
-                        scraper_get_offset_to_char(&scene->engine->scraper, menu_bar_items[data->menu_bar.index]);
-                    _main_scene_update_rom_entries(scene);
-                    data->menu_roms.index = 0;
+                    _main_scene_jump_to_bucket(scene);
                 }
                 data->dirty = true;
                 break;
 
+            case SDL_CONTROLLER_BUTTON_Y:
+                /* type to search */
+                if (engine_push_scene(scene->engine, &search_scene, NULL) != 0)
+                    warning("main_scene", "failed to open search");
+                break;
+
             case SDL_CONTROLLER_BUTTON_BACK:
                 {
                     SDL_QuitEvent e;
@@ -0,0 +1,210 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory.h>
+#include <endian.h>
+
+#include "logger.h"
+#include "movie.h"
+
+#define MOVIE_FRAMES_CHUNK (60 * 60)
+
+int
+movie_record(movie_t *movie, const char *filename,
+             const char *core_name, uint32_t rom_crc32)
+{
+    memset(movie, 0, sizeof(movie_t));
+
+    memcpy(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic));
+    movie->header.version = MOVIE_VERSION;
+    movie->header.rom_crc32 = rom_crc32;
+    snprintf(movie->header.core_name, sizeof(movie->header.core_name), "%s", core_name);
+    snprintf(movie->filename, sizeof(movie->filename), "%s", filename);
+
+    movie->capacity = MOVIE_FRAMES_CHUNK;
+    movie->frames = malloc(movie->capacity * sizeof(uint16_t));
+    if (movie->frames == NULL)
+        return 1;
+
+    movie->recording = true;
+    return 0;
+}
+
+int
+movie_open(movie_t *movie, const char *filename)
+{
+    int fd;
+    size_t size;
+    uint32_t i;
+
+    memset(movie, 0, sizeof(movie_t));
+    snprintf(movie->filename, sizeof(movie->filename), "%s", filename);
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    if (read(fd, &movie->header, sizeof(movie_header_t)) != sizeof(movie_header_t))
+        goto fail;
+
+    movie->header.version = le32toh(movie->header.version);
+    movie->header.rom_crc32 = le32toh(movie->header.rom_crc32);
+    movie->header.frame_count = le32toh(movie->header.frame_count);
+    movie->header.core_name[sizeof(movie->header.core_name) - 1] = '\0';
+
+    if (memcmp(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic)) != 0
+        || movie->header.version != MOVIE_VERSION)
+    {
+        error("movie", "'%s' is not a movie file", filename);
+        goto fail;
+    }
+
+    movie->capacity = movie->header.frame_count;
+    size = movie->capacity * sizeof(uint16_t);
+    movie->frames = malloc(size ? size : 1);
+    if (movie->frames == NULL)
+        goto fail;
+
+    if (read(fd, movie->frames, size) != size)
+    {
+        error("movie", "'%s' is truncated", filename);
+        goto fail;
+    }
+
+    for (i = 0; i < movie->header.frame_count; i++)
+        movie->frames[i] = le16toh(movie->frames[i]);
+
+    close(fd);
+    return 0;
+
+fail:
+    close(fd);
+    free(movie->frames);
+    movie->frames = NULL;
+    return 1;
+}
+
+static int
+_movie_write(movie_t *movie)
+{
+    int fd;
+    size_t size;
+    uint32_t i;
+    movie_header_t hdr;
+
+    hdr = movie->header;
+    hdr.version = htole32(hdr.version);
+    hdr.rom_crc32 = htole32(hdr.rom_crc32);
+    hdr.frame_count = htole32(hdr.frame_count);
+
+    for (i = 0; i < movie->header.frame_count; i++)
+        movie->frames[i] = htole16(movie->frames[i]);
+
+    fd = open(movie->filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0)
+        return 1;
+
+    size = movie->header.frame_count * sizeof(uint16_t);
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || write(fd, movie->frames, size) != size)
+    {
+        close(fd);
+        return 1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+int
+movie_close(movie_t *movie)
+{
+    int res = 0;
+
+    if (movie->recording)
+    {
+        res = _movie_write(movie);
+        if (res != 0)
+            error("movie", "failed to write movie '%s'", movie->filename);
+        else
+            notice("movie", "recorded %u frames to '%s'",
+                   movie->header.frame_count, movie->filename);
+    }
+
+    free(movie->frames);
+    movie->frames = NULL;
+    movie->recording = false;
+    return res;
+}
+
+/*
+ * Append the joypad state of a frame, fails if the frame could not be
+ * stored and the movie would desync on replay, the frames recorded so
+ * far are kept for movie_close().
+ */
+int
+movie_push(movie_t *movie, uint16_t joypad_state)
+{
+    uint16_t *frames;
+
+    if (movie->header.frame_count == movie->capacity)
+    {
+        frames = realloc(movie->frames,
+                         (movie->capacity + MOVIE_FRAMES_CHUNK) * sizeof(uint16_t));
+        if (frames == NULL)
+        {
+            error("movie", "out of memory after %u frames of '%s'",
+                  movie->header.frame_count, movie->filename);
+            return 1;
+        }
+
+        movie->frames = frames;
+        movie->capacity += MOVIE_FRAMES_CHUNK;
+    }
+
+    movie->frames[movie->header.frame_count++] = joypad_state;
+    return 0;
+}
+
+uint16_t
+movie_pull(movie_t *movie)
+{
+    if (movie->frame >= movie->header.frame_count)
+        return 0;
+
+    return movie->frames[movie->frame++];
+}
+
+bool
+movie_eof(movie_t *movie)
+{
+    return movie->frame >= movie->header.frame_count;
+}
+
+uint32_t
+movie_frame_count(movie_t *movie)
+{
+    return movie->header.frame_count;
+}
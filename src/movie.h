@@ -0,0 +1,63 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _movie_h
+#define _movie_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define MOVIE_MAGIC "HJMV"
+#define MOVIE_VERSION 1
+
+/*
+ * On disk a movie is a movie_header_t followed by frame_count little
+ * endian uint16_t joypad states, one for each retro_run().
+ */
+typedef struct movie_header_t {
+    uint8_t magic[4];
+    uint32_t version;
+    uint32_t rom_crc32;
+    uint32_t frame_count;
+    char core_name[64];
+} movie_header_t;
+
+typedef struct movie_t {
+    movie_header_t header;
+    char filename[1024];
+    bool recording;
+    uint16_t *frames;
+    size_t capacity;
+    uint32_t frame;
+} movie_t;
+
+int movie_record(movie_t *movie, const char *filename,
+                 const char *core_name, uint32_t rom_crc32);
+int movie_open(movie_t *movie, const char *filename);
+int movie_close(movie_t *movie);
+
+int movie_push(movie_t *movie, uint16_t joypad_state);
+uint16_t movie_pull(movie_t *movie);
+bool movie_eof(movie_t *movie);
+uint32_t movie_frame_count(movie_t *movie);
+
+#endif /* _movie_h */
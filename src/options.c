@@ -0,0 +1,343 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <memory.h>
+
+#include "hash.h"
+#include "options.h"
+
+#define OPTIONS_CHUNK_SIZE 4096
+#define OPTIONS_VALUES_MAX 128
+
+static void *
+_options_alloc(options_t *options, size_t size)
+{
+    void *p;
+    options_chunk_t *chunk;
+
+    /* keep pointer arrays aligned */
+    size = (size + 7) & ~(size_t)7;
+
+    chunk = options->chunks;
+    if (chunk == NULL || chunk->used + size > chunk->size)
+    {
+        chunk = malloc(sizeof(options_chunk_t)
+                       + (size > OPTIONS_CHUNK_SIZE ? size : OPTIONS_CHUNK_SIZE));
+        if (chunk == NULL)
+            return NULL;
+
+        chunk->used = 0;
+        chunk->size = size > OPTIONS_CHUNK_SIZE ? size : OPTIONS_CHUNK_SIZE;
+        chunk->next = options->chunks;
+        options->chunks = chunk;
+    }
+
+    p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+static int
+_options_grow_strings(options_t *options)
+{
+    size_t i, slot, size;
+    const char **strings;
+
+    size = options->strings ? (options->strings_mask + 1) * 2 : 64;
+    strings = calloc(size, sizeof(const char *));
+    if (strings == NULL)
+        return 1;
+
+    for (i = 0; options->strings && i <= options->strings_mask; i++)
+    {
+        if (options->strings[i] == NULL)
+            continue;
+
+        slot = hash64(options->strings[i], strlen(options->strings[i]), 0) & (size - 1);
+        while (strings[slot] != NULL)
+            slot = (slot + 1) & (size - 1);
+        strings[slot] = options->strings[i];
+    }
+
+    free(options->strings);
+    options->strings = strings;
+    options->strings_mask = size - 1;
+    return 0;
+}
+
+/* unique copy of the first len bytes of str */
+static const char *
+_options_intern(options_t *options, const char *str, size_t len)
+{
+    size_t slot;
+    char *copy;
+
+    if ((options->string_count + 1) * 2 > options->strings_mask + 1
+        && _options_grow_strings(options) != 0)
+        return NULL;
+
+    slot = hash64(str, len, 0) & options->strings_mask;
+    while (options->strings[slot] != NULL)
+    {
+        if (strncmp(options->strings[slot], str, len) == 0
+            && options->strings[slot][len] == '\0')
+            return options->strings[slot];
+        slot = (slot + 1) & options->strings_mask;
+    }
+
+    copy = _options_alloc(options, len + 1);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    options->strings[slot] = copy;
+    options->string_count++;
+    return copy;
+}
+
+static int
+_options_grow_index(options_t *options)
+{
+    size_t i, slot, size;
+    uint32_t *index;
+    const char *key;
+
+    size = options->index ? (options->index_mask + 1) * 2 : 64;
+    index = calloc(size, sizeof(uint32_t));
+    if (index == NULL)
+        return 1;
+
+    for (i = 0; i < options->count; i++)
+    {
+        key = options->entries[i].key;
+        slot = hash64(key, strlen(key), 0) & (size - 1);
+        while (index[slot] != 0)
+            slot = (slot + 1) & (size - 1);
+        index[slot] = i + 1;
+    }
+
+    free(options->index);
+    options->index = index;
+    options->index_mask = size - 1;
+    return 0;
+}
+
+/* returns the index slot of key, or the empty slot where it belongs */
+static size_t
+_options_slot(options_t *options, const char *key)
+{
+    size_t slot;
+
+    slot = hash64(key, strlen(key), 0) & options->index_mask;
+    while (options->index[slot] != 0
+           && strcmp(options->entries[options->index[slot] - 1].key, key) != 0)
+        slot = (slot + 1) & options->index_mask;
+
+    return slot;
+}
+
+static option_t *
+_options_find(options_t *options, const char *key)
+{
+    size_t slot;
+
+    if (options->index == NULL || key == NULL)
+        return NULL;
+
+    slot = _options_slot(options, key);
+    if (options->index[slot] == 0)
+        return NULL;
+
+    return &options->entries[options->index[slot] - 1];
+}
+
+static option_t *
+_options_add(options_t *options, const char *key)
+{
+    size_t slot, capacity;
+    option_t *entries, *option;
+
+    if ((options->count + 1) * 2 > options->index_mask + 1
+        && _options_grow_index(options) != 0)
+        return NULL;
+
+    if (options->count == options->capacity)
+    {
+        capacity = options->capacity ? options->capacity * 2 : 32;
+        entries = realloc(options->entries, capacity * sizeof(option_t));
+        if (entries == NULL)
+            return NULL;
+        options->entries = entries;
+        options->capacity = capacity;
+    }
+
+    option = &options->entries[options->count];
+    memset(option, 0, sizeof(option_t));
+    option->key = _options_intern(options, key, strlen(key));
+    if (option->key == NULL)
+        return NULL;
+
+    slot = _options_slot(options, key);
+    options->index[slot] = ++options->count;
+    return option;
+}
+
+int
+options_init(options_t *options)
+{
+    memset(options, 0, sizeof(options_t));
+
+    if (_options_grow_index(options) != 0 || _options_grow_strings(options) != 0)
+    {
+        options_deinit(options);
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+options_deinit(options_t *options)
+{
+    options_chunk_t *chunk, *next;
+
+    for (chunk = options->chunks; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(options->entries);
+    free(options->index);
+    free(options->strings);
+    memset(options, 0, sizeof(options_t));
+}
+
+/*
+ * Define options from RETRO_ENVIRONMENT_SET_VARIABLES, values are on
+ * the form "Description; first|second|...", where the first choice is
+ * the default. A current value still valid after a redefinition is
+ * kept.
+ */
+int
+options_define(options_t *options, const struct retro_variable *vars)
+{
+    size_t i, count;
+    const char *ps, *pe;
+    const char *values[OPTIONS_VALUES_MAX];
+    option_t *option;
+
+    for (; vars->key != NULL; vars++)
+    {
+        if (vars->value == NULL || (ps = strstr(vars->value, "; ")) == NULL)
+            continue;
+
+        count = 0;
+        for (ps += 2; *ps != '\0' && count < OPTIONS_VALUES_MAX; ps = *pe ? pe + 1 : pe)
+        {
+            pe = strchr(ps, '|');
+            if (pe == NULL)
+                pe = ps + strlen(ps);
+
+            values[count] = _options_intern(options, ps, pe - ps);
+            if (values[count] == NULL)
+                return 1;
+            count++;
+        }
+
+        if (count == 0)
+            continue;
+
+        option = _options_find(options, vars->key);
+        if (option == NULL && (option = _options_add(options, vars->key)) == NULL)
+            return 1;
+
+        option->values = _options_alloc(options, count * sizeof(const char *));
+        if (option->values == NULL)
+            return 1;
+        memcpy(option->values, values, count * sizeof(const char *));
+        option->value_count = count;
+
+        /* interned strings compare by pointer */
+        for (i = 0; i < count; i++)
+        {
+            if (option->values[i] == option->value)
+                break;
+        }
+
+        if (i == count)
+            option->value = option->values[0];
+    }
+
+    return 0;
+}
+
+const char *
+options_get(options_t *options, const char *key)
+{
+    option_t *option;
+
+    option = _options_find(options, key);
+    return option ? option->value : NULL;
+}
+
+/* select one of the defined choices of an option */
+int
+options_set(options_t *options, const char *key, const char *value)
+{
+    size_t i;
+    option_t *option;
+
+    option = _options_find(options, key);
+    if (option == NULL || value == NULL)
+        return 1;
+
+    for (i = 0; i < option->value_count; i++)
+    {
+        if (strcmp(option->values[i], value) == 0)
+            break;
+    }
+
+    if (i == option->value_count)
+        return 1;
+
+    if (option->value != option->values[i])
+    {
+        option->value = option->values[i];
+        options->dirty = true;
+    }
+
+    return 0;
+}
+
+/* true once after options changed, for RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE */
+bool
+options_updated(options_t *options)
+{
+    bool dirty;
+
+    dirty = options->dirty;
+    options->dirty = false;
+    return dirty;
+}
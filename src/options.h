@@ -0,0 +1,74 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _options_h
+#define _options_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libretro.h"
+
+typedef struct option_t {
+    const char *key;
+    const char *value;
+    const char **values;
+    size_t value_count;
+} option_t;
+
+typedef struct options_chunk_t {
+    struct options_chunk_t *next;
+    size_t used;
+    size_t size;
+    char data[];
+} options_chunk_t;
+
+/*
+ * Core option store, an open addressing table from option key to its
+ * current value. Keys and values are interned into chunks which are
+ * only released by options_deinit(), so returned strings stay valid
+ * for the lifetime of the store.
+ */
+typedef struct options_t {
+    option_t *entries;
+    size_t count;
+    size_t capacity;
+
+    uint32_t *index;
+    size_t index_mask;
+
+    const char **strings;
+    size_t string_count;
+    size_t strings_mask;
+
+    options_chunk_t *chunks;
+    bool dirty;
+} options_t;
+
+int options_init(options_t *options);
+void options_deinit(options_t *options);
+int options_define(options_t *options, const struct retro_variable *vars);
+const char *options_get(options_t *options, const char *key);
+int options_set(options_t *options, const char *key, const char *value);
+bool options_updated(options_t *options);
+
+#endif /* _options_h */
@@ -143,6 +143,9 @@ overlay_render(overlay_t *overlay, SDL_Renderer *renderer)
     int icon;
     SDL_Rect or, d, tmp;
 
+    /* profiler hud is toggled from the overlay but shown on its own */
+    profiler_render(&overlay->engine->profiler, renderer);
+
     /* if overlay is hidden, skip */
     if (overlay->show == false)
         return;
@@ -254,7 +257,15 @@ overlay_handle_event(overlay_t *overlay, SDL_Event *event)
                     SDL_SetWindowBrightness(overlay->engine->window,
                                             overlay->brightness / (double)MAX_CTRL_VALUE);
                 }
+                break;
 
+            case SDL_CONTROLLER_BUTTON_GUIDE:
+                if (overlay->show)
+                {
+                    profiler_show(&overlay->engine->profiler,
+                                  !overlay->engine->profiler.hud);
+                }
+                break;
         }
     }
     else if (event->type == SDL_CONTROLLERBUTTONUP)
@@ -301,5 +312,9 @@ int overlay_tick(overlay_t *overlay)
         return 1;
     }
 
+    /* keep profiler hud live */
+    if (overlay->engine->profiler.hud)
+        return 1;
+
     return 0;
 }
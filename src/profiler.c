@@ -0,0 +1,362 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <memory.h>
+
+#include "logger.h"
+#include "draw.h"
+#include "profiler.h"
+
+static const char *_profiler_glyphs = "0123456789.ms ";
+
+static const char *_profiler_labels[PROFILER_PHASES] = {
+    "run",
+    "upload",
+    "render",
+    "present",
+    "audio",
+    "idle",
+};
+
+static SDL_Color _profiler_colors[PROFILER_PHASES] = {
+    {0xe0, 0x40, 0x40, 0xff}, /* PROFILER_RUN */
+    {0xe0, 0xa0, 0x20, 0xff}, /* PROFILER_UPLOAD */
+    {0x40, 0xc0, 0x40, 0xff}, /* PROFILER_RENDER */
+    {0x40, 0x80, 0xe0, 0xff}, /* PROFILER_PRESENT */
+    {0xc0, 0x40, 0xe0, 0xff}, /* PROFILER_AUDIO */
+    {0x80, 0x80, 0x80, 0xff}, /* PROFILER_IDLE */
+};
+
+/*
+ * Glyphs for numbers are rendered once into a single texture so that
+ * drawing the HUD does not rasterize text every frame.
+ */
+static int
+_profiler_create_glyphs(profiler_t *profiler, SDL_Renderer *renderer, TTF_Font *font)
+{
+    int i, x, h;
+    char ch[2] = {0};
+    SDL_Rect d;
+    SDL_Surface *atlas, *glyph;
+    SDL_Color white = {0xff, 0xff, 0xff, 0xff};
+
+    atlas = NULL;
+    x = h = 0;
+    for (i = 0; _profiler_glyphs[i] != '\0'; i++)
+    {
+        ch[0] = _profiler_glyphs[i];
+        glyph = render_text(font, TTF_STYLE_NORMAL, white, ch);
+        if (glyph == NULL)
+            goto fail;
+
+        if (atlas == NULL)
+        {
+            h = glyph->h;
+            atlas = SDL_CreateRGBSurfaceWithFormat(0, h * 16, h, 32, SDL_PIXELFORMAT_RGBA32);
+            if (atlas == NULL)
+            {
+                SDL_FreeSurface(glyph);
+                goto fail;
+            }
+        }
+
+        d.x = x;
+        d.y = 0;
+        d.w = glyph->w;
+        d.h = glyph->h;
+        SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(glyph, NULL, atlas, &d);
+        profiler->glyph_rects[i] = d;
+        x += glyph->w;
+        SDL_FreeSurface(glyph);
+    }
+
+    profiler->glyphs = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_SetTextureBlendMode(profiler->glyphs, SDL_BLENDMODE_BLEND);
+    SDL_FreeSurface(atlas);
+    return profiler->glyphs ? 0 : 1;
+
+fail:
+    if (atlas)
+        SDL_FreeSurface(atlas);
+    return 1;
+}
+
+int
+profiler_init(profiler_t *profiler, SDL_Renderer *renderer, const char *font_file, uint32_t size)
+{
+    int i;
+    TTF_Font *font;
+    SDL_Surface *surface;
+
+    memset(profiler, 0, sizeof(profiler_t));
+    profiler->frequency = SDL_GetPerformanceFrequency();
+
+    font = TTF_OpenFont(font_file, size);
+    if (font == NULL)
+    {
+        error("profiler", "failed to load font");
+        return 1;
+    }
+
+    for (i = 0; i < PROFILER_PHASES; i++)
+    {
+        surface = render_text(font, TTF_STYLE_NORMAL, _profiler_colors[i], _profiler_labels[i]);
+        if (surface == NULL)
+            goto fail;
+        profiler->labels[i] = SDL_CreateTextureFromSurface(renderer, surface);
+        SDL_FreeSurface(surface);
+    }
+
+    if (_profiler_create_glyphs(profiler, renderer, font) != 0)
+    {
+        error("profiler", "failed to create glyph texture");
+        goto fail;
+    }
+
+    TTF_CloseFont(font);
+    return 0;
+
+fail:
+    TTF_CloseFont(font);
+    return 1;
+}
+
+void
+profiler_deinit(profiler_t *profiler)
+{
+    int i;
+
+    for (i = 0; i < PROFILER_PHASES; i++)
+    {
+        if (profiler->labels[i])
+            SDL_DestroyTexture(profiler->labels[i]);
+        profiler->labels[i] = NULL;
+    }
+
+    if (profiler->glyphs)
+        SDL_DestroyTexture(profiler->glyphs);
+    profiler->glyphs = NULL;
+}
+
+static void
+_profiler_update(profiler_t *profiler)
+{
+    bool enabled = profiler->hud || profiler->record;
+
+    if (enabled != profiler->enabled)
+    {
+        profiler->frame_start = 0;
+        profiler->events = 0;
+        profiler->nested = 0;
+        memset(profiler->ticks, 0, sizeof(profiler->ticks));
+    }
+
+    profiler->enabled = enabled;
+}
+
+void
+profiler_show(profiler_t *profiler, bool show)
+{
+    profiler->hud = show;
+    _profiler_update(profiler);
+}
+
+void
+profiler_record(profiler_t *profiler, bool record)
+{
+    profiler->record = record;
+    _profiler_update(profiler);
+}
+
+/*
+ * Completes the current frame and starts a new one, returns true when
+ * a completed frame is available in last_ticks.
+ */
+bool
+profiler_frame(profiler_t *profiler)
+{
+    int i;
+    uint64_t now, busy;
+    float *sample;
+
+    if (!profiler->enabled)
+        return false;
+
+    now = SDL_GetPerformanceCounter();
+    if (profiler->frame_start == 0)
+    {
+        profiler->frame_start = now;
+        return false;
+    }
+
+    /*
+     * upload and audio of the callbacks run inside retro_run, report run
+     * exclusive of them, audio flushed after it as in fast forward is not
+     */
+    if (profiler->ticks[PROFILER_RUN] > profiler->nested)
+        profiler->ticks[PROFILER_RUN] -= profiler->nested;
+    else
+        profiler->ticks[PROFILER_RUN] = 0;
+
+    busy = 0;
+    for (i = 0; i < PROFILER_IDLE; i++)
+        busy += profiler->ticks[i];
+    profiler->ticks[PROFILER_IDLE] = (now - profiler->frame_start) > busy
+                                     ? (now - profiler->frame_start) - busy : 0;
+
+    sample = profiler->history[profiler->head];
+    for (i = 0; i < PROFILER_PHASES; i++)
+    {
+        sample[i] = profiler->ticks[i] * 1000.0 / profiler->frequency;
+        profiler->average[i] = profiler->average[i] * 0.95f + sample[i] * 0.05f;
+    }
+
+    profiler->head = (profiler->head + 1) % PROFILER_HISTORY;
+
+    memcpy(profiler->last_ticks, profiler->ticks, sizeof(profiler->ticks));
+    profiler->last_total = now - profiler->frame_start;
+    profiler->last_events = profiler->events;
+    profiler->last_audio_fill = profiler->audio_fill;
+
+    profiler->frame_start = now;
+    profiler->events = 0;
+    profiler->nested = 0;
+    memset(profiler->ticks, 0, sizeof(profiler->ticks));
+    return true;
+}
+
+static void
+_profiler_render_number(profiler_t *profiler, SDL_Renderer *renderer,
+                        int x, int y, const char *text)
+{
+    const char *pglyph;
+    SDL_Rect d;
+
+    for (; *text != '\0'; text++)
+    {
+        pglyph = strchr(_profiler_glyphs, *text);
+        if (pglyph == NULL)
+            continue;
+
+        d = profiler->glyph_rects[pglyph - _profiler_glyphs];
+        d.x = x;
+        d.y = y;
+        SDL_RenderCopy(renderer, profiler->glyphs,
+                       &profiler->glyph_rects[pglyph - _profiler_glyphs], &d);
+        x += d.w;
+    }
+}
+
+void
+profiler_render(profiler_t *profiler, SDL_Renderer *renderer)
+{
+    int i, p, w, h;
+    int x, y, lh, lw, column;
+    float scale, *sample;
+    char text[16];
+    SDL_Rect area, d;
+    SDL_Rect bars[PROFILER_HISTORY];
+
+    if (!profiler->hud || profiler->glyphs == NULL)
+        return;
+
+    SDL_GetRendererOutputSize(renderer, &w, &h);
+
+    area.x = area.y = 0;
+    area.w = w / 2;
+    area.h = h / 2;
+
+    SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0xa0);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderFillRect(renderer, &area);
+
+    /* legend with rolling averages */
+    lh = profiler->glyph_rects[0].h;
+    lw = 0;
+    for (i = 0; i < PROFILER_PHASES; i++)
+    {
+        SDL_QueryTexture(profiler->labels[i], NULL, NULL, &d.w, &d.h);
+        if (d.w > lw)
+            lw = d.w;
+    }
+
+    y = area.y;
+    for (i = 0; i < PROFILER_PHASES; i++)
+    {
+        SDL_QueryTexture(profiler->labels[i], NULL, NULL, &d.w, &d.h);
+        d.x = area.x + 2;
+        d.y = y;
+        SDL_RenderCopy(renderer, profiler->labels[i], NULL, &d);
+
+        snprintf(text, sizeof(text), "%.2f ms", profiler->average[i]);
+        _profiler_render_number(profiler, renderer, area.x + lw + 8, y, text);
+        y += lh;
+    }
+
+    /* stacked bar graph of history, 2x the 60 Hz budget fills the graph */
+    d.x = area.x;
+    d.y = y;
+    d.w = area.w;
+    d.h = area.h - (y - area.y);
+    if (d.h <= 0)
+        return;
+
+    scale = d.h / (2 * 1000.0f / 60.0f);
+    column = d.w / PROFILER_HISTORY;
+    if (column < 1)
+        column = 1;
+
+    for (p = 0; p < PROFILER_PHASES; p++)
+    {
+        for (i = 0; i < PROFILER_HISTORY; i++)
+        {
+            float below = 0;
+            int k;
+
+            sample = profiler->history[(profiler->head + i) % PROFILER_HISTORY];
+            for (k = 0; k < p; k++)
+                below += sample[k];
+
+            x = d.x + i * column;
+            bars[i].x = x;
+            bars[i].w = column;
+            bars[i].h = sample[p] * scale;
+            bars[i].y = d.y + d.h - (below * scale) - bars[i].h;
+            if (bars[i].y < d.y)
+            {
+                bars[i].h -= d.y - bars[i].y;
+                bars[i].y = d.y;
+            }
+            if (bars[i].h < 0)
+                bars[i].h = 0;
+        }
+
+        SDL_SetRenderDrawColor(renderer, _profiler_colors[p].r, _profiler_colors[p].g,
+                               _profiler_colors[p].b, 0xc0);
+        SDL_RenderFillRects(renderer, bars, PROFILER_HISTORY);
+    }
+
+    /* frame budget line */
+    SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+    SDL_RenderDrawLine(renderer, d.x, d.y + d.h / 2, d.x + d.w, d.y + d.h / 2);
+}
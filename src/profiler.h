@@ -0,0 +1,120 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _profiler_h
+#define _profiler_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#define PROFILER_HISTORY 120
+
+typedef enum profiler_phase_t {
+    PROFILER_RUN = 0,
+    PROFILER_UPLOAD,
+    PROFILER_RENDER,
+    PROFILER_PRESENT,
+    PROFILER_AUDIO,
+    PROFILER_IDLE,
+    PROFILER_PHASES
+} profiler_phase_t;
+
+/*
+ * Per-frame profiler, phases are accumulated with performance counter
+ * timestamps during a frame and pushed into a rolling history when the
+ * next frame begins. Time not spent in any phase is accounted as idle.
+ */
+typedef struct profiler_t {
+    bool enabled;
+    bool hud;
+    bool record;
+    uint64_t frequency;
+    uint64_t frame_start;
+    uint64_t ticks[PROFILER_PHASES];
+    /* ticks of phases measured inside retro_run, excluded from run */
+    uint64_t nested;
+    uint32_t events;
+    int32_t audio_fill;
+
+    /* last completed frame */
+    uint64_t last_ticks[PROFILER_PHASES];
+    uint64_t last_total;
+    uint32_t last_events;
+    int32_t last_audio_fill;
+
+    float history[PROFILER_HISTORY][PROFILER_PHASES];
+    uint32_t head;
+    float average[PROFILER_PHASES];
+
+    SDL_Texture *labels[PROFILER_PHASES];
+    SDL_Texture *glyphs;
+    SDL_Rect glyph_rects[16];
+} profiler_t;
+
+int profiler_init(profiler_t *profiler, SDL_Renderer *renderer, const char *font_file, uint32_t size);
+void profiler_deinit(profiler_t *profiler);
+void profiler_show(profiler_t *profiler, bool show);
+void profiler_record(profiler_t *profiler, bool record);
+bool profiler_frame(profiler_t *profiler);
+void profiler_render(profiler_t *profiler, SDL_Renderer *renderer);
+
+static inline uint64_t
+profiler_begin(profiler_t *profiler)
+{
+    return profiler->enabled ? SDL_GetPerformanceCounter() : 0;
+}
+
+static inline void
+profiler_end(profiler_t *profiler, profiler_phase_t phase, uint64_t begin)
+{
+    if (profiler->enabled && begin)
+        profiler->ticks[phase] += SDL_GetPerformanceCounter() - begin;
+}
+
+/* ends a phase measured inside retro_run, from one of its callbacks */
+static inline void
+profiler_end_nested(profiler_t *profiler, profiler_phase_t phase, uint64_t begin)
+{
+    uint64_t ticks;
+
+    if (profiler->enabled && begin)
+    {
+        ticks = SDL_GetPerformanceCounter() - begin;
+        profiler->ticks[phase] += ticks;
+        profiler->nested += ticks;
+    }
+}
+
+static inline void
+profiler_event(profiler_t *profiler)
+{
+    profiler->events++;
+}
+
+static inline void
+profiler_audio_fill(profiler_t *profiler, int32_t frames)
+{
+    profiler->audio_fill = frames;
+}
+
+#endif /* _profiler_h */
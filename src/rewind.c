@@ -0,0 +1,230 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <memory.h>
+
+#include "logger.h"
+#include "compress.h"
+#include "rewind.h"
+
+static uint64_t
+_rewind_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static rewind_entry_t *
+_rewind_entry(rewind_t *rewind, uint32_t index)
+{
+    return &rewind->entries[(rewind->first + index) % REWIND_MAX_ENTRIES];
+}
+
+static void
+_rewind_drop_oldest(rewind_t *rewind)
+{
+    rewind->first = (rewind->first + 1) % REWIND_MAX_ENTRIES;
+    rewind->count--;
+}
+
+/*
+ * Find room for size bytes after the newest entry, dropping the oldest
+ * entries it would overwrite.
+ */
+static size_t
+_rewind_reserve(rewind_t *rewind, size_t size)
+{
+    size_t pos;
+    rewind_entry_t *newest;
+
+    if (rewind->count == REWIND_MAX_ENTRIES)
+        _rewind_drop_oldest(rewind);
+
+    pos = 0;
+    if (rewind->count)
+    {
+        newest = _rewind_entry(rewind, rewind->count - 1);
+        pos = newest->offset + newest->size;
+    }
+
+    if (pos + size > rewind->buffer_size)
+    {
+        /* entries left at the end of the buffer are the oldest ones */
+        while (rewind->count && _rewind_entry(rewind, 0)->offset >= pos)
+            _rewind_drop_oldest(rewind);
+        pos = 0;
+    }
+
+    while (rewind->count
+           && _rewind_entry(rewind, 0)->offset >= pos
+           && _rewind_entry(rewind, 0)->offset < pos + size)
+        _rewind_drop_oldest(rewind);
+
+    return pos;
+}
+
+int
+rewind_init(rewind_t *rewind, core_t *core, size_t budget, uint32_t interval)
+{
+    memset(rewind, 0, sizeof(rewind_t));
+
+    if (core->api.retro_serialize_size == NULL || core->api.retro_serialize == NULL)
+        return 1;
+
+    rewind->core = core;
+    rewind->interval = interval ? interval : 1;
+    rewind->state_size = core->api.retro_serialize_size();
+    if (rewind->state_size == 0)
+        return 1;
+
+    /* budget must at least hold one worst case delta */
+    rewind->buffer_size = budget;
+    if (rewind->buffer_size < COMPRESS_DELTA_BOUND(rewind->state_size))
+        rewind->buffer_size = COMPRESS_DELTA_BOUND(rewind->state_size);
+
+    rewind->current = malloc(rewind->state_size);
+    rewind->next = malloc(rewind->state_size);
+    rewind->buffer = malloc(rewind->buffer_size);
+    if (rewind->current == NULL || rewind->next == NULL || rewind->buffer == NULL)
+    {
+        rewind_deinit(rewind);
+        return 1;
+    }
+
+    notice("rewind", "state size %zu bytes, %zu KB budget, capture every %u frames",
+           rewind->state_size, rewind->buffer_size / 1024, rewind->interval);
+    return 0;
+}
+
+void
+rewind_deinit(rewind_t *rewind)
+{
+    free(rewind->current);
+    free(rewind->next);
+    free(rewind->buffer);
+    rewind->current = rewind->next = rewind->buffer = NULL;
+    rewind->count = 0;
+    rewind->has_state = false;
+}
+
+int
+rewind_capture(rewind_t *rewind)
+{
+    size_t pos, size;
+    uint8_t *tmp;
+    uint64_t start, elapsed;
+    rewind_entry_t *entry;
+
+    start = _rewind_now();
+
+    if (!rewind->core->api.retro_serialize(rewind->next, rewind->state_size))
+        return 1;
+
+    /* store delta back to the previous state */
+    if (rewind->has_state)
+    {
+        pos = _rewind_reserve(rewind, COMPRESS_DELTA_BOUND(rewind->state_size));
+        size = compress_delta_encode(rewind->next, rewind->current, rewind->state_size,
+                                     rewind->buffer + pos, rewind->buffer_size - pos);
+        if (size == 0)
+            return 1;
+
+        entry = _rewind_entry(rewind, rewind->count);
+        entry->offset = pos;
+        entry->size = size;
+        rewind->count++;
+        rewind->stats.bytes += size;
+    }
+
+    tmp = rewind->current;
+    rewind->current = rewind->next;
+    rewind->next = tmp;
+    rewind->has_state = true;
+
+    elapsed = _rewind_now() - start;
+    rewind->stats.captures++;
+    rewind->stats.capture_ns += elapsed;
+    if (elapsed > rewind->stats.capture_max_ns)
+        rewind->stats.capture_max_ns = elapsed;
+
+    return 0;
+}
+
+void
+rewind_frame(rewind_t *rewind)
+{
+    if ((rewind->frame++ % rewind->interval) != 0)
+        return;
+
+    rewind_capture(rewind);
+}
+
+int
+rewind_step_back(rewind_t *rewind)
+{
+    rewind_entry_t *entry;
+
+    if (!rewind->has_state)
+        return 1;
+
+    /* apply newest delta to get back to the previous state */
+    if (rewind->count)
+    {
+        entry = _rewind_entry(rewind, rewind->count - 1);
+        if (compress_delta_decode(rewind->buffer + entry->offset, entry->size,
+                                  rewind->current, rewind->state_size) != 0)
+            return 1;
+        rewind->count--;
+    }
+
+    if (!rewind->core->api.retro_unserialize(rewind->current, rewind->state_size))
+        return 1;
+
+    /* restart capture interval from the restored state */
+    rewind->frame = 1;
+    return 0;
+}
+
+void
+rewind_report(rewind_t *rewind)
+{
+    double average;
+    uint32_t deltas;
+
+    if (rewind->stats.captures == 0)
+        return;
+
+    average = rewind->stats.capture_ns / (double)rewind->stats.captures;
+    deltas = rewind->stats.captures > 1 ? rewind->stats.captures - 1 : 1;
+
+    notice("rewind", "%u captures, %.3f ms average, %.3f ms max",
+           rewind->stats.captures, average / 1e6, rewind->stats.capture_max_ns / 1e6);
+    if (rewind->stats.bytes == 0)
+        return;
+
+    notice("rewind", "%.1f bytes per state, %.1f states per MB, %u states held",
+           rewind->stats.bytes / (double)deltas,
+           (1024.0 * 1024.0) / (rewind->stats.bytes / (double)deltas),
+           rewind->count);
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _rewind_h
+#define _rewind_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "core.h"
+
+#define REWIND_MAX_ENTRIES 16384
+
+typedef struct rewind_entry_t {
+    uint32_t offset;
+    uint32_t size;
+} rewind_entry_t;
+
+typedef struct rewind_stats_t {
+    uint32_t captures;
+    uint64_t capture_ns;
+    uint64_t capture_max_ns;
+    uint64_t bytes;
+} rewind_stats_t;
+
+/*
+ * Rewind buffer, keeps the latest serialized state and a ring of XOR
+ * deltas back to older states within a fixed memory budget.
+ */
+typedef struct rewind_t {
+    core_t *core;
+    uint32_t interval;
+    uint32_t frame;
+
+    size_t state_size;
+    uint8_t *current;
+    uint8_t *next;
+    bool has_state;
+
+    uint8_t *buffer;
+    size_t buffer_size;
+    rewind_entry_t entries[REWIND_MAX_ENTRIES];
+    uint32_t first;
+    uint32_t count;
+
+    rewind_stats_t stats;
+} rewind_t;
+
+int rewind_init(rewind_t *rewind, core_t *core, size_t budget, uint32_t interval);
+void rewind_deinit(rewind_t *rewind);
+void rewind_frame(rewind_t *rewind);
+int rewind_capture(rewind_t *rewind);
+int rewind_step_back(rewind_t *rewind);
+void rewind_report(rewind_t *rewind);
+
+#endif /* _rewind_h */
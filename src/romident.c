@@ -21,9 +21,11 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <strings.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <memory.h>
+#include <sys/stat.h>
 
 #include "romident.h"
 
@@ -75,6 +77,7 @@ _ident_string_trim(uint8_t *data, size_t len)
     /* identified */
     memset(result, 0, sizeof(romident_rom_data_t));
     result->system = ROMIDENT_NES;
+    result->header_size = 16;
     return 0;
  }
 
@@ -95,6 +98,7 @@ _ident_snes_rom(int fd, romident_rom_data_t *result)
         uint8_t compplementary_checksum[2];
         uint8_t checksum[2];
     } hdr;
+    struct stat st;
 
     uint32_t header_offsets[] = {
         0x7fff  - 0x40 + 1,
@@ -131,6 +135,10 @@ identified:
     memcpy(result->name, hdr.game_title, 21);
     result->system = ROMIDENT_SNES;
     result->crc32 = *(uint32_t*)hdr.checksum;
+
+    /* 512 byte SMC/SWC copier header makes the size uneven */
+    if (fstat(fd, &st) == 0 && (st.st_size % 1024) == 512)
+        result->header_size = 512;
     return 0;
 }
 
@@ -267,12 +275,39 @@ romident_init(romident_t *ident)
     return 0;
 }
 
+/*
+ * Copier header size from the first bytes and total size of a rom
+ * which can not be opened as a file, such as a zip archive member.
+ * Only headers that are recognizable without the whole rom are found,
+ * iNES and the 512 byte header of SNES copier dumps.
+ */
+uint32_t
+romident_header_size(const char *filename, const uint8_t *data, size_t len, uint64_t size)
+{
+    const char *ext;
+    uint8_t magic[] = {'N', 'E', 'S', 0x1a};
+
+    if (len >= sizeof(magic) && memcmp(data, magic, sizeof(magic)) == 0)
+        return 16;
+
+    ext = strrchr(filename, '.');
+    if (ext && (size % 1024) == 512
+        && (strcasecmp(ext, ".smc") == 0 || strcasecmp(ext, ".sfc") == 0
+            || strcasecmp(ext, ".swc") == 0 || strcasecmp(ext, ".fig") == 0))
+        return 512;
+
+    return 0;
+}
+
 int
 romident_identify(romident_t *ident, const char *filename, romident_rom_data_t *result)
 {
+    int res;
     int fd = open(filename, O_RDONLY);
     if (fd < 0)
         return 1;
 
-    return _romident_identify(ident, fd, result);
+    res = _romident_identify(ident, fd, result);
+    close(fd);
+    return res;
 }
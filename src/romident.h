@@ -23,6 +23,7 @@
 #define _romident_h
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef enum romident_system_t
 {
@@ -42,9 +43,12 @@ typedef struct romident_rom_data_t
     int8_t name[64];
     romident_system_t system;
     uint32_t crc32;
+    /* size of a copier header preceding the rom payload */
+    uint32_t header_size;
 } romident_rom_data_t;
 
 int romident_init(romident_t *ident);
 int romident_identify(romident_t *ident, const char *filename, romident_rom_data_t *result);
+uint32_t romident_header_size(const char *filename, const uint8_t *data, size_t len, uint64_t size);
 
 #endif /* _romident_h */
\ No newline at end of file
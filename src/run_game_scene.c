@@ -24,20 +24,79 @@
 #include "engine.h"
 #include "draw.h"
 #include "vfs.h"
+#include "crc32.h"
+#include "movie.h"
+#include "rewind.h"
+#include "sram.h"
+#include "zip.h"
+#include "in_game_menu.h"
+#include <time.h>
+#include <unistd.h>
 #include <SDL_ttf.h>
 #include <asoundlib.h>
 
 extern scene_t in_game_menu_scene;
 
+#define FAST_FORWARD_AUDIO_FRAMES 4096
+#define TRIGGER_THRESHOLD 16384
+
 typedef struct {
     engine_t *engine;
     SDL_Texture *screen;
     scraper_rom_entry_t *rom_entry;
+    /* file handed to the core, extracted when the rom is zipped */
+    char game_path[4096];
+    char extract_dir[4096];
+    bool extracted;
     struct core_t *core;
     snd_pcm_t *pcm;
+    snd_pcm_uframes_t pcm_buffer_size;
     int width;
     int height;
     uint16_t joypad_state;
+    uint16_t frame_joypad_state;
+    bool recording;
+    movie_t movie;
+    /* handed to the in game menu */
+    in_game_menu_t menu;
+    double fps;
+
+    struct {
+        bool active;
+        bool skip_video;
+        uint32_t ratio;
+        uint32_t runs;
+        double run_ms;
+        uint32_t audio_phase;
+        size_t audio_len;
+        int16_t audio[FAST_FORWARD_AUDIO_FRAMES * 2];
+    } fast_forward;
+
+    struct {
+        uint32_t start_tick;
+        uint32_t frames;
+        double multiplier;
+    } speed;
+
+    struct {
+        bool enabled;
+        bool active;
+        rewind_t buffer;
+    } rewind;
+
+    struct {
+        bool enabled;
+        uint32_t interval;
+        uint32_t last_tick;
+        char path[4096];
+    } resume;
+
+    struct {
+        bool enabled;
+        uint32_t interval;
+        uint32_t last_tick;
+        sram_t region;
+    } sram;
 } run_game_scene_data_t;
 
 run_game_scene_data_t _run_game_scene_data;
@@ -87,8 +146,13 @@ _run_game_retro_video_refresh_callback(const void *data, unsigned width, unsigne
     engine_t *engine = _run_game_scene_data.engine;
     void *tdata;
     int tpitch;
+    uint64_t t;
     SDL_Rect rect;
 
+    /* only the last frame of a fast forward batch is presented */
+    if (_run_game_scene_data.fast_forward.skip_video || data == NULL)
+        return;
+
     if (_run_game_scene_data.screen == NULL
         || (_run_game_scene_data.width != width || _run_game_scene_data.height != height))
     {
@@ -102,6 +166,8 @@ _run_game_retro_video_refresh_callback(const void *data, unsigned width, unsigne
         _run_game_scene_data.height = height;
     }
 
+    t = profiler_begin(&engine->profiler);
+
     rect.x = rect.y = 0;
     rect.w = width;
     rect.h = height;
@@ -120,6 +186,8 @@ _run_game_retro_video_refresh_callback(const void *data, unsigned width, unsigne
     }
 
     SDL_UnlockTexture(_run_game_scene_data.screen);
+
+    profiler_end_nested(&engine->profiler, PROFILER_UPLOAD, t);
 }
 
 static void
@@ -128,10 +196,51 @@ _run_game_retro_audio_sample_callback(int16_t left, int16_t right)
     /* TODO */
 }
 
+static size_t
+_run_game_fast_forward_audio(const int16_t *data, size_t frames)
+{
+    size_t i;
+    uint32_t step;
+    int16_t *dst;
+
+    /* decimate audio by the fast forward speed */
+    step = _run_game_scene_data.fast_forward.runs;
+    if (step == 0)
+        step = 1;
+
+    for (i = 0; i < frames; i++)
+    {
+        if ((_run_game_scene_data.fast_forward.audio_phase++ % step) != 0)
+            continue;
+
+        if (_run_game_scene_data.fast_forward.audio_len == FAST_FORWARD_AUDIO_FRAMES)
+            break;
+
+        dst = _run_game_scene_data.fast_forward.audio
+              + (_run_game_scene_data.fast_forward.audio_len * 2);
+        dst[0] = data[i * 2];
+        dst[1] = data[i * 2 + 1];
+        _run_game_scene_data.fast_forward.audio_len++;
+    }
+
+    return frames;
+}
+
 static size_t
 _run_game_retro_audio_sample_batch_callback(const int16_t *data, size_t frames)
 {
     int res;
+    uint64_t t;
+    snd_pcm_sframes_t avail;
+
+    /* rewinding plays back silent */
+    if (_run_game_scene_data.rewind.active)
+        return frames;
+
+    if (_run_game_scene_data.fast_forward.active)
+        return _run_game_fast_forward_audio(data, frames);
+
+    t = profiler_begin(&_run_game_scene_data.engine->profiler);
     while(1)
     {
         res = snd_pcm_writei(_run_game_scene_data.pcm, data, frames);
@@ -140,6 +249,16 @@ _run_game_retro_audio_sample_batch_callback(const int16_t *data, size_t frames)
 
         snd_pcm_recover(_run_game_scene_data.pcm, res, 0);
     }
+    profiler_end_nested(&_run_game_scene_data.engine->profiler, PROFILER_AUDIO, t);
+
+    /* frames queued in the pcm buffer for the hitch recorder */
+    if (_run_game_scene_data.engine->profiler.enabled)
+    {
+        avail = snd_pcm_avail_update(_run_game_scene_data.pcm);
+        if (avail >= 0)
+            profiler_audio_fill(&_run_game_scene_data.engine->profiler,
+                                _run_game_scene_data.pcm_buffer_size - avail);
+    }
 
     return frames;
 }
@@ -156,13 +275,53 @@ _run_game_retro_input_state_callback(unsigned port, unsigned device, unsigned in
     if (device == RETRO_DEVICE_JOYPAD && port == 0)
     {
         debug("State 0x%x, Port %d, device %d. index %d, id %d\n",
-            (_run_game_scene_data.joypad_state >> id) & 1, port, device, index, id);
-        return (_run_game_scene_data.joypad_state >> id) & 1;
+            (_run_game_scene_data.frame_joypad_state >> id) & 1, port, device, index, id);
+        return (_run_game_scene_data.frame_joypad_state >> id) & 1;
     }
     return 0;
 }
 
 
+/*
+ * Per core option choices live in config under
+ * /hjortron/options/<core name>/<key>, a stored choice replaces the
+ * default and all current values are written back so they can be
+ * edited.
+ */
+static void
+_run_game_scene_persist_options(core_t *core)
+{
+    size_t i;
+    char *pc;
+    char name[128];
+    char path[512];
+    const char *value;
+    option_t *option;
+    config_t *config = &_run_game_scene_data.engine->config;
+
+    snprintf(name, sizeof(name), "%s", core->name);
+    for (pc = name; *pc; pc++)
+    {
+        if (*pc == '/')
+            *pc = '_';
+    }
+
+    for (i = 0; i < core->options.count; i++)
+    {
+        option = &core->options.entries[i];
+        snprintf(path, sizeof(path), "/hjortron/options/%s/%s", name, option->key);
+
+        value = config_get(config, path, NULL);
+        if (value && options_set(&core->options, option->key, value) != 0)
+            warning("run_game_scene", "ignoring invalid value '%s' for option %s", value, option->key);
+
+        config_set(config, path, option->value);
+    }
+
+    /* choices are applied before the core reads any of them */
+    options_updated(&core->options);
+}
+
 static bool
 _run_game_retro_environment_callback(unsigned cmd, void *data)
 {
@@ -237,40 +396,23 @@ _run_game_retro_environment_callback(unsigned cmd, void *data)
 
         case RETRO_ENVIRONMENT_SET_VARIABLES:
         {
-            struct retro_variable *pvar = data;
-            while(pvar->key)
-            {
-                char value[64] = {};
-                char *ps, *pe;
-                pe = strchr(pvar->value, '|');
-                if (pe == NULL)
-                {
-                    pvar++;
-                    continue;
-                }
-
-                ps = pe;
-                while (*ps != ' ') ps--;
-                ps++;
-                strncat(value, ps, pe-ps);
-
-                core_variable_set(core, pvar->key, value);
-                pvar++;
-            }
+            if (options_define(&core->options, data) != 0)
+                return false;
+            _run_game_scene_persist_options(core);
             return true;
         } break;
 
         case RETRO_ENVIRONMENT_GET_VARIABLE:
         {
-             struct retro_variable *pvar = data;
-             pvar->value = core_variable_get(core, pvar->key);
-            return true;
+            struct retro_variable *pvar = data;
+            pvar->value = options_get(&core->options, pvar->key);
+            return pvar->value != NULL;
         } break;
 
         case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
         {
             bool *presult = data;
-            *presult = false;
+            *presult = options_updated(&core->options);
             return true;
         } break;
 
@@ -290,7 +432,7 @@ _run_game_retro_environment_callback(unsigned cmd, void *data)
         case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
         {
             const char **pval = data;
-            *pval = "/tmp";
+            *pval = config_get(&_run_game_scene_data.engine->config, "/hjortron/directories/saves", "/tmp");
             return true;
         } break;
 
@@ -305,7 +447,16 @@ _run_game_retro_environment_callback(unsigned cmd, void *data)
         {
             int *pval = data;
 
-            *pval = (1<<0) | (1<<1);
+            *pval = (1<<1);
+            if (!_run_game_scene_data.fast_forward.skip_video)
+                *pval |= (1<<0);
+            return true;
+        } break;
+
+        case RETRO_ENVIRONMENT_GET_FASTFORWARDING:
+        {
+            bool *pval = data;
+            *pval = _run_game_scene_data.fast_forward.active;
             return true;
         } break;
 
@@ -315,6 +466,264 @@ _run_game_retro_environment_callback(unsigned cmd, void *data)
     }
     return false;
 }
+static void
+_run_game_scene_start_recording(struct scene_t *scene)
+{
+    char filename[4096];
+    const char *basename;
+    uint32_t rom_crc32;
+    run_game_scene_data_t *data = scene->opaque;
+
+    data->recording = false;
+
+    if (strcmp("true", config_get(&scene->engine->config, "/hjortron/movie/record", "false")) != 0)
+        return;
+
+    if (crc32_file(data->game_path, &rom_crc32) != 0)
+        return;
+
+    basename = strrchr(data->rom_entry->path, '/');
+    basename = basename ? basename + 1 : data->rom_entry->path;
+    snprintf(filename, sizeof(filename), "%s/%s.hjmv",
+             config_get(&scene->engine->config, "/hjortron/directories/movies", "/tmp"),
+             basename);
+
+    if (movie_record(&data->movie, filename, data->core->name, rom_crc32) != 0)
+    {
+        warning("run_game_scene", "failed to start recording of movie '%s'", filename);
+        return;
+    }
+
+    notice("run_game_scene", "recording input movie to '%s'", filename);
+    data->recording = true;
+}
+
+static void
+_run_game_scene_start_rewind(struct scene_t *scene)
+{
+    size_t budget;
+    uint32_t interval;
+    run_game_scene_data_t *data = scene->opaque;
+
+    data->rewind.enabled = false;
+    data->rewind.active = false;
+
+    if (strcmp("true", config_get(&scene->engine->config, "/hjortron/rewind/enable", "false")) != 0)
+        return;
+
+    /* a rewound session can not be replayed from its input movie */
+    if (data->recording)
+    {
+        warning("run_game_scene", "rewind is disabled while recording a movie");
+        return;
+    }
+
+    budget = strtoul(config_get(&scene->engine->config, "/hjortron/rewind/budget", "16"), NULL, 10);
+    interval = strtoul(config_get(&scene->engine->config, "/hjortron/rewind/interval", "2"), NULL, 10);
+
+    if (rewind_init(&data->rewind.buffer, data->core, budget * 1024 * 1024, interval) != 0)
+    {
+        warning("run_game_scene", "rewind is not supported by core %s", data->core->name);
+        return;
+    }
+
+    data->rewind.enabled = true;
+}
+
+static void
+_run_game_scene_start_sram(struct scene_t *scene)
+{
+    run_game_scene_data_t *data = scene->opaque;
+    config_t *config = &scene->engine->config;
+
+    /*
+     * a movie must start from power on as it is replayed without save
+     * ram, the session is neither loaded from nor written to the .srm
+     */
+    if (data->recording)
+    {
+        warning("run_game_scene", "battery saves are disabled while recording a movie");
+        data->sram.enabled = false;
+        return;
+    }
+
+    data->sram.enabled = sram_init(&data->sram.region, data->core,
+                                   config_get(config, "/hjortron/directories/saves", "/tmp"),
+                                   data->rom_entry->path) == 0;
+    data->sram.interval = 1000 * strtoul(config_get(config, "/hjortron/sram/interval", "10"), NULL, 10);
+    data->sram.last_tick = SDL_GetTicks();
+}
+
+/* periodic flush survives power loss, writes only when sram changed */
+static void
+_run_game_scene_flush_sram(struct scene_t *scene, bool force)
+{
+    run_game_scene_data_t *data = scene->opaque;
+
+    if (!data->sram.enabled)
+        return;
+
+    if (!force && (data->sram.interval == 0
+                   || SDL_GetTicks() - data->sram.last_tick < data->sram.interval))
+        return;
+
+    data->sram.last_tick = SDL_GetTicks();
+    sram_flush(&data->sram.region, &scene->engine->savestate);
+}
+
+/*
+ * Instant resume, a suspend state is written when the game is quit and
+ * periodically while playing, then restored right after the game is
+ * loaded on next launch of the same rom. The suspend state is recorded
+ * in the states table like the slots and only restored into the core
+ * that wrote it.
+ */
+static void
+_run_game_scene_start_resume(struct scene_t *scene)
+{
+    size_t cnt;
+    scraper_state_entry_t state;
+    run_game_scene_data_t *data = scene->opaque;
+    config_t *config = &scene->engine->config;
+
+    /* a movie must start from power on to replay */
+    data->resume.enabled = !data->recording
+        && strcmp("true", config_get(config, "/hjortron/states/resume", "true")) == 0;
+    if (!data->resume.enabled)
+        return;
+
+    data->resume.interval = 1000 * strtoul(config_get(config, "/hjortron/states/autosave", "60"), NULL, 10);
+    data->resume.last_tick = SDL_GetTicks();
+
+    savestate_path(data->resume.path, sizeof(data->resume.path),
+                   config_get(config, "/hjortron/directories/states", "/tmp"),
+                   data->rom_entry->path, SAVESTATE_SLOT_AUTO);
+
+    if (access(data->resume.path, F_OK) != 0)
+        return;
+
+    /* the auto slot sorts first */
+    cnt = 1;
+    if (scraper_get_states(&scene->engine->scraper, data->rom_entry->path, &state, &cnt) != 0
+        || cnt == 0 || state.slot != SAVESTATE_SLOT_AUTO)
+    {
+        warning("run_game_scene", "suspend state '%s' has no record, not resuming",
+                data->resume.path);
+        return;
+    }
+
+    if (strcmp(state.core, data->core->name) != 0)
+    {
+        warning("run_game_scene", "suspend state was saved by core '%s', not resuming",
+                state.core);
+        return;
+    }
+
+    if (strcmp(state.core_version, data->core->version) != 0)
+        warning("run_game_scene", "suspend state was saved by %s version %s",
+                state.core, state.core_version);
+
+    if (savestate_load(&scene->engine->savestate, data->core, data->resume.path) != 0)
+    {
+        warning("run_game_scene", "failed to resume from '%s'", data->resume.path);
+        return;
+    }
+
+    notice("run_game_scene", "resumed from '%s'", data->resume.path);
+}
+
+static void
+_run_game_scene_suspend(struct scene_t *scene)
+{
+    scraper_state_entry_t state;
+    run_game_scene_data_t *data = scene->opaque;
+
+    data->resume.last_tick = SDL_GetTicks();
+
+    memset(&state, 0, sizeof(state));
+    state.slot = SAVESTATE_SLOT_AUTO;
+    state.timestamp = time(NULL);
+    state.size = data->core->api.retro_serialize_size();
+    snprintf(state.core, sizeof(state.core), "%s", data->core->name);
+    snprintf(state.core_version, sizeof(state.core_version), "%s", data->core->version);
+
+    if (savestate_save(&scene->engine->savestate, data->core, data->resume.path) != 0)
+    {
+        warning("run_game_scene", "failed to write suspend state '%s'", data->resume.path);
+        return;
+    }
+
+    if (scraper_put_state(&scene->engine->scraper, data->rom_entry->path, &state) != 0)
+        warning("run_game_scene", "failed to index suspend state '%s'", data->resume.path);
+}
+
+static void
+_run_game_scene_autosave(struct scene_t *scene)
+{
+    run_game_scene_data_t *data = scene->opaque;
+
+    if (!data->resume.enabled || data->resume.interval == 0)
+        return;
+
+    if (SDL_GetTicks() - data->resume.last_tick >= data->resume.interval)
+        _run_game_scene_suspend(scene);
+}
+
+/*
+ * Zipped roms are extracted into a private directory created for each
+ * launch, the member keeps its name since cores look at the extension.
+ */
+static int
+_run_game_scene_prepare_game(struct scene_t *scene)
+{
+    char archive[4096];
+    const char *member, *basename;
+    run_game_scene_data_t *data = scene->opaque;
+
+    data->extracted = false;
+    member = zip_member(data->rom_entry->path, archive, sizeof(archive));
+    if (member == NULL)
+    {
+        snprintf(data->game_path, sizeof(data->game_path), "%s", data->rom_entry->path);
+        return 0;
+    }
+
+    snprintf(data->extract_dir, sizeof(data->extract_dir), "%s/hjortron-XXXXXX",
+             config_get(&scene->engine->config, "/hjortron/directories/extract", "/tmp"));
+    if (mkdtemp(data->extract_dir) == NULL)
+    {
+        error("run_game_scene", "failed to create directory '%s'", data->extract_dir);
+        return 1;
+    }
+
+    basename = strrchr(member, '/');
+    basename = basename ? basename + 1 : member;
+    snprintf(data->game_path, sizeof(data->game_path), "%s/%s", data->extract_dir, basename);
+
+    if (zip_extract_member(data->rom_entry->path, data->game_path) != 0)
+    {
+        error("run_game_scene", "failed to extract '%s'", data->rom_entry->path);
+        rmdir(data->extract_dir);
+        return 1;
+    }
+
+    data->extracted = true;
+    return 0;
+}
+
+static void
+_run_game_scene_remove_game(struct scene_t *scene)
+{
+    run_game_scene_data_t *data = scene->opaque;
+
+    if (!data->extracted)
+        return;
+
+    unlink(data->game_path);
+    rmdir(data->extract_dir);
+    data->extracted = false;
+}
+
 #include <sys/stat.h>
 static int
 _run_game_scene_mount(struct scene_t *scene, void *opaque)
@@ -330,8 +739,17 @@ _run_game_scene_mount(struct scene_t *scene, void *opaque)
     if (data->core == NULL)
         return 1;
 
+    if (_run_game_scene_prepare_game(scene) != 0)
+        return 1;
+
+    /* libraries are only loaded once a game launches on them */
+    if (core_load(data->core) != 0)
+    {
+        error("run_game_scene", "failed to load core '%s'", data->core->path);
+        goto fail;
+    }
+
     data->core->api.retro_set_environment(_run_game_retro_environment_callback);
-    //json_dumpfd(data->core->variables, 0, 0);
 
     data->core->api.retro_set_video_refresh(_run_game_retro_video_refresh_callback);
     data->core->api.retro_set_audio_sample(_run_game_retro_audio_sample_callback);
@@ -342,18 +760,31 @@ _run_game_scene_mount(struct scene_t *scene, void *opaque)
     data->core->api.retro_init();
 
     data->width = data->height = 0;
+    data->joypad_state = data->frame_joypad_state = 0;
 
-    game.path = data->rom_entry->path;
+    game.path = data->game_path;
     data->core->api.retro_load_game(&game);
 
+    _run_game_scene_start_recording(scene);
+    _run_game_scene_start_sram(scene);
+    _run_game_scene_start_resume(scene);
+    _run_game_scene_start_rewind(scene);
+
     struct retro_system_av_info av;
     data->core->api.retro_get_system_av_info(&av);
+    data->fps = av.timing.fps > 0 ? av.timing.fps : 60.0;
+
+    /* fast forward speed, 0 runs uncapped */
+    memset(&data->fast_forward, 0, sizeof(data->fast_forward));
+    memset(&data->speed, 0, sizeof(data->speed));
+    data->fast_forward.ratio = strtoul(config_get(&scene->engine->config,
+                                       "/hjortron/fastforward/ratio", "4"), NULL, 10);
 
     int err;
     if ((err = snd_pcm_open(&data->pcm, "default", SND_PCM_STREAM_PLAYBACK, 0)) < 0)
     {
         error("run_game_scene", "failed to open playback device %s", snd_strerror(err));
-        return 1;
+        goto fail_game;
     }
 
     err = snd_pcm_set_params(data->pcm, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED,
@@ -361,10 +792,41 @@ _run_game_scene_mount(struct scene_t *scene, void *opaque)
     if (err < 0)
     {
         error("run_game_scene", "Failed to configure audio device: %s", snd_strerror(err));
-        return 1;
+        snd_pcm_close(data->pcm);
+        goto fail_game;
     }
 
+    snd_pcm_uframes_t period_size;
+    if (snd_pcm_get_params(data->pcm, &data->pcm_buffer_size, &period_size) < 0)
+        data->pcm_buffer_size = 0;
+
     return 0;
+
+fail_game:
+    /* no frame has run, nothing is suspended or written back */
+    if (data->rewind.enabled)
+    {
+        rewind_deinit(&data->rewind.buffer);
+        data->rewind.enabled = false;
+    }
+
+    if (data->recording)
+    {
+        /* an empty movie would replace an earlier recording */
+        data->movie.recording = false;
+        movie_close(&data->movie);
+        data->recording = false;
+    }
+
+    data->sram.enabled = false;
+    data->resume.enabled = false;
+
+    data->core->api.retro_unload_game();
+    data->core->api.retro_deinit();
+
+fail:
+    _run_game_scene_remove_game(scene);
+    return 1;
 }
 
 static void
@@ -372,8 +834,30 @@ _run_game_scene_unmount(struct scene_t *scene)
 {
     run_game_scene_data_t *data = scene->opaque;
     snd_pcm_close(data->pcm);
+
+    /* serialized before unload, written in the background */
+    if (data->resume.enabled)
+        _run_game_scene_suspend(scene);
+    _run_game_scene_flush_sram(scene, true);
+    data->sram.enabled = false;
+
+    if (data->recording)
+    {
+        movie_close(&data->movie);
+        data->recording = false;
+    }
+
+    if (data->rewind.enabled)
+    {
+        rewind_report(&data->rewind.buffer);
+        rewind_deinit(&data->rewind.buffer);
+        data->rewind.enabled = false;
+    }
+
     data->core->api.retro_unload_game();
     data->core->api.retro_deinit();
+
+    _run_game_scene_remove_game(scene);
 }
 
 static void
@@ -381,12 +865,17 @@ _run_game_scene_enter(struct scene_t *scene)
 {
     run_game_scene_data_t *data = scene->opaque;
     snd_pcm_pause(data->pcm, 0);
+
+    hitch_arm(&scene->engine->hitch, true);
 }
 
 static void
 _run_game_scene_leave(struct scene_t *scene)
 {
     run_game_scene_data_t *data = scene->opaque;
+
+    hitch_arm(&scene->engine->hitch, false);
+
     snd_pcm_drain(data->pcm);
     snd_pcm_pause(data->pcm, 1);
 }
@@ -407,6 +896,167 @@ _run_game_scene_render_back(struct scene_t *scene, SDL_Renderer *renderer)
 static void
 _run_game_scene_render_overlay(struct scene_t *scene, SDL_Renderer *renderer)
 {
+    int w, h;
+    char text[32];
+    SDL_Rect d;
+    SDL_Color white = {0xff, 0xff, 0xff, 0xff};
+    run_game_scene_data_t *data = scene->opaque;
+
+    if (!data->fast_forward.active)
+        return;
+
+    /* show achieved fast forward speed */
+    SDL_GetRendererOutputSize(renderer, &w, &h);
+    d.x = d.y = 0;
+    d.w = w - 5;
+    d.h = h / 8;
+    snprintf(text, sizeof(text), ">> x%.1f", data->speed.multiplier);
+    draw_text(renderer, scene->engine->font, TTF_STYLE_BOLD,
+              white, ALIGN_RIGHT, text, &d);
+}
+
+static void
+_run_game_scene_run_frame(struct scene_t *scene)
+{
+    uint64_t t;
+    run_game_scene_data_t *data = scene->opaque;
+
+    /* a movie missing a frame would desync, keep what was recorded */
+    if (data->recording && movie_push(&data->movie, data->frame_joypad_state) != 0)
+    {
+        warning("run_game_scene", "stopped recording of movie '%s'", data->movie.filename);
+        movie_close(&data->movie);
+        data->recording = false;
+    }
+
+    t = profiler_begin(&scene->engine->profiler);
+    data->core->api.retro_run();
+    profiler_end(&scene->engine->profiler, PROFILER_RUN, t);
+    data->speed.frames++;
+
+    if (data->rewind.enabled)
+        rewind_frame(&data->rewind.buffer);
+}
+
+static void
+_run_game_scene_pace(struct scene_t *scene, uint64_t start)
+{
+    double budget_ms, elapsed_ms;
+    run_game_scene_data_t *data = scene->opaque;
+
+    /* pace presented frames to the core frame rate */
+    budget_ms = 1000.0 / data->fps;
+    elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    if (elapsed_ms < budget_ms)
+        SDL_Delay(budget_ms - elapsed_ms);
+}
+
+static void
+_run_game_scene_rewind(struct scene_t *scene)
+{
+    uint64_t start, t;
+    run_game_scene_data_t *data = scene->opaque;
+
+    start = SDL_GetPerformanceCounter();
+
+    /* restore previous state and run it once to get its video frame */
+    t = profiler_begin(&scene->engine->profiler);
+    rewind_step_back(&data->rewind.buffer);
+    data->core->api.retro_run();
+    profiler_end(&scene->engine->profiler, PROFILER_RUN, t);
+
+    _run_game_scene_pace(scene, start);
+}
+
+static void
+_run_game_scene_fast_forward_flush_audio(struct scene_t *scene)
+{
+    uint64_t t;
+    snd_pcm_sframes_t avail;
+    run_game_scene_data_t *data = scene->opaque;
+
+    t = profiler_begin(&scene->engine->profiler);
+
+    /* never block on the pcm device, drop what does not fit */
+    avail = snd_pcm_avail_update(data->pcm);
+    if (avail < 0)
+    {
+        snd_pcm_recover(data->pcm, avail, 1);
+        avail = 0;
+    }
+
+    if (avail > data->fast_forward.audio_len)
+        avail = data->fast_forward.audio_len;
+
+    if (avail > 0)
+        snd_pcm_writei(data->pcm, data->fast_forward.audio, avail);
+
+    data->fast_forward.audio_len = 0;
+    profiler_end(&scene->engine->profiler, PROFILER_AUDIO, t);
+}
+
+static void
+_run_game_scene_fast_forward(struct scene_t *scene)
+{
+    bool last;
+    uint32_t runs;
+    double budget_ms, elapsed_ms;
+    uint64_t start, freq;
+    run_game_scene_data_t *data = scene->opaque;
+
+    freq = SDL_GetPerformanceFrequency();
+    budget_ms = 1000.0 / data->fps;
+    start = SDL_GetPerformanceCounter();
+
+    /*
+     * Run several frames per presented frame, with a fixed ratio or
+     * as many as fits within one frame when uncapped.
+     */
+    runs = 0;
+    do
+    {
+        if (data->fast_forward.ratio)
+        {
+            last = (runs + 1) >= data->fast_forward.ratio;
+        }
+        else
+        {
+            elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / freq;
+            last = (elapsed_ms + data->fast_forward.run_ms * 2) >= budget_ms;
+        }
+
+        data->fast_forward.skip_video = !last;
+        _run_game_scene_run_frame(scene);
+        runs++;
+    } while (!last);
+
+    data->fast_forward.skip_video = false;
+
+    elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / freq;
+    data->fast_forward.run_ms = elapsed_ms / runs;
+    data->fast_forward.runs = runs;
+
+    _run_game_scene_fast_forward_flush_audio(scene);
+
+    _run_game_scene_pace(scene, start);
+}
+
+static void
+_run_game_scene_update_speed(struct scene_t *scene)
+{
+    uint32_t now;
+    run_game_scene_data_t *data = scene->opaque;
+
+    now = SDL_GetTicks();
+    if (data->speed.start_tick == 0)
+        data->speed.start_tick = now;
+
+    if (now - data->speed.start_tick < 500)
+        return;
+
+    data->speed.multiplier = (data->speed.frames * 1000.0 / (now - data->speed.start_tick)) / data->fps;
+    data->speed.start_tick = now;
+    data->speed.frames = 0;
 }
 
 static int
@@ -414,7 +1064,20 @@ _run_game_scene_tick(struct scene_t *scene)
 {
     run_game_scene_data_t *data = scene->opaque;
     //SDL_Delay(1);
-    data->core->api.retro_run();
+
+    /* latch input state so it is stable for the whole frame */
+    data->frame_joypad_state = data->joypad_state;
+
+    if (data->rewind.active)
+        _run_game_scene_rewind(scene);
+    else if (data->fast_forward.active)
+        _run_game_scene_fast_forward(scene);
+    else
+        _run_game_scene_run_frame(scene);
+
+    _run_game_scene_update_speed(scene);
+    _run_game_scene_autosave(scene);
+    _run_game_scene_flush_sram(scene, false);
     return 1;
 }
 
@@ -447,6 +1110,18 @@ _run_game_scene_handle_event(struct scene_t *scene, SDL_Event *event)
             else if (event->caxis.value < 0)
                 data->joypad_state |= (1 << RETRO_DEVICE_ID_JOYPAD_DOWN);
         }
+        else if (event->caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT)
+        {
+            /* Hold to fast forward */
+            data->fast_forward.active = event->caxis.value > TRIGGER_THRESHOLD;
+            data->fast_forward.audio_len = 0;
+        }
+        else if (event->caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERLEFT)
+        {
+            /* Hold to rewind */
+            data->rewind.active = data->rewind.enabled
+                                  && event->caxis.value > TRIGGER_THRESHOLD;
+        }
     }
     else if (event->type == SDL_CONTROLLERBUTTONDOWN)
     {
@@ -491,7 +1166,9 @@ _run_game_scene_handle_event(struct scene_t *scene, SDL_Event *event)
         /* Handle special case for in game menu access */
         if (event->cbutton.button == SDL_CONTROLLER_BUTTON_BACK)
         {
-            engine_push_scene(scene->engine, &in_game_menu_scene, data->core);
+            data->menu.rom_entry = data->rom_entry;
+            data->menu.recording = data->recording;
+            engine_push_scene(scene->engine, &in_game_menu_scene, &data->menu);
         }
     }
     else if (event->type == SDL_CONTROLLERBUTTONUP)
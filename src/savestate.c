@@ -0,0 +1,448 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory.h>
+#include <endian.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "logger.h"
+#include "compress.h"
+#include "crc32.h"
+#include "savestate.h"
+
+static uint64_t
+_savestate_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+_savestate_reserve(uint8_t **buffer, size_t *capacity, size_t size)
+{
+    uint8_t *p;
+
+    if (size <= *capacity)
+        return 0;
+
+    p = realloc(*buffer, size);
+    if (p == NULL)
+        return 1;
+
+    *buffer = p;
+    *capacity = size;
+    return 0;
+}
+
+static int
+_savestate_write_all(int fd, const uint8_t *data, size_t size)
+{
+    ssize_t n;
+
+    while (size > 0)
+    {
+        n = write(fd, data, size);
+        if (n <= 0)
+            return 1;
+        data += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+/* write to a temporary file and rename it over the old one so a crash
+   never leaves a truncated file behind */
+static int
+_savestate_replace(const char *filename, const uint8_t *data, size_t size)
+{
+    int fd;
+    char tmp[sizeof(((savestate_t *)0)->filename) + 8];
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+    fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0)
+        return 1;
+
+    if (_savestate_write_all(fd, data, size) != 0 || fsync(fd) != 0)
+    {
+        close(fd);
+        unlink(tmp);
+        return 1;
+    }
+    close(fd);
+
+    if (rename(tmp, filename) != 0)
+    {
+        unlink(tmp);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* compress and atomically replace filename, runs on the writer thread */
+static int
+_savestate_write(savestate_t *savestate, const uint8_t *state, size_t size,
+                 const char *filename, uint64_t serialize_ns)
+{
+    size_t compressed_size;
+    uint64_t start, compressed_ns;
+    savestate_header_t *hdr;
+
+    if (_savestate_reserve(&savestate->compressed, &savestate->compressed_capacity,
+                           sizeof(savestate_header_t) + COMPRESS_LZ_BOUND(size)) != 0)
+        return 1;
+
+    start = _savestate_now();
+    compressed_size = compress_lz_encode(state, size,
+                                         savestate->compressed + sizeof(savestate_header_t),
+                                         savestate->compressed_capacity - sizeof(savestate_header_t));
+    if (compressed_size == 0)
+        return 1;
+    compressed_ns = _savestate_now() - start;
+
+    hdr = (savestate_header_t *)savestate->compressed;
+    memcpy(hdr->magic, SAVESTATE_MAGIC, sizeof(hdr->magic));
+    hdr->version = htole32(SAVESTATE_VERSION);
+    hdr->size = htole32(size);
+    hdr->compressed_size = htole32(compressed_size);
+
+    start = _savestate_now();
+    if (_savestate_replace(filename, savestate->compressed,
+                           sizeof(savestate_header_t) + compressed_size) != 0)
+        return 1;
+
+    notice("savestate", "saved %zu bytes as %zu to '%s', serialize %.3f ms, compress %.3f ms, write %.3f ms",
+           size, compressed_size, filename, serialize_ns / 1e6, compressed_ns / 1e6,
+           (_savestate_now() - start) / 1e6);
+    return 0;
+}
+
+/* raw copy of a memory region, runs on the writer thread */
+static int
+_savestate_write_raw(const uint8_t *data, size_t size, const char *filename)
+{
+    uint64_t start;
+
+    start = _savestate_now();
+    if (_savestate_replace(filename, data, size) != 0)
+        return 1;
+
+    notice("savestate", "wrote %zu bytes to '%s' in %.3f ms",
+           size, filename, (_savestate_now() - start) / 1e6);
+    return 0;
+}
+
+static void *
+_savestate_writer(void *opaque)
+{
+    savestate_t *savestate = opaque;
+    uint8_t *state;
+    size_t size;
+    uint64_t serialize_ns;
+    bool compress;
+    const char *filename = savestate->writing;
+    int res;
+
+    pthread_mutex_lock(&savestate->lock);
+    while (true)
+    {
+        while (!savestate->pending && savestate->running)
+            pthread_cond_wait(&savestate->cond, &savestate->lock);
+
+        /* pending saves are written before the thread exits */
+        if (!savestate->pending)
+            break;
+
+        state = savestate->job;
+        size = savestate->job_size;
+        serialize_ns = savestate->job_serialize_ns;
+        compress = savestate->job_compress;
+        snprintf(savestate->writing, sizeof(savestate->writing), "%s", savestate->filename);
+        savestate->pending = false;
+        savestate->busy = true;
+        pthread_cond_broadcast(&savestate->cond);
+        pthread_mutex_unlock(&savestate->lock);
+
+        if (compress)
+            res = _savestate_write(savestate, state, size, filename, serialize_ns);
+        else
+            res = _savestate_write_raw(state, size, filename);
+
+        if (res != 0)
+            error("savestate", "failed to write '%s'", filename);
+
+        pthread_mutex_lock(&savestate->lock);
+        savestate->busy = false;
+        pthread_cond_broadcast(&savestate->cond);
+    }
+    pthread_mutex_unlock(&savestate->lock);
+
+    return NULL;
+}
+
+int
+savestate_init(savestate_t *savestate)
+{
+    memset(savestate, 0, sizeof(savestate_t));
+
+    pthread_mutex_init(&savestate->lock, NULL);
+    pthread_cond_init(&savestate->cond, NULL);
+
+    savestate->running = true;
+    if (pthread_create(&savestate->thread, NULL, _savestate_writer, savestate) != 0)
+    {
+        error("savestate", "failed to start writer thread");
+        savestate->running = false;
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+savestate_deinit(savestate_t *savestate)
+{
+    if (savestate->running)
+    {
+        pthread_mutex_lock(&savestate->lock);
+        savestate->running = false;
+        pthread_cond_broadcast(&savestate->cond);
+        pthread_mutex_unlock(&savestate->lock);
+        pthread_join(savestate->thread, NULL);
+    }
+
+    pthread_cond_destroy(&savestate->cond);
+    pthread_mutex_destroy(&savestate->lock);
+
+    free(savestate->buffers[0]);
+    free(savestate->buffers[1]);
+    free(savestate->compressed);
+}
+
+void
+savestate_flush(savestate_t *savestate)
+{
+    pthread_mutex_lock(&savestate->lock);
+    while (savestate->pending || savestate->busy)
+        pthread_cond_wait(&savestate->cond, &savestate->lock);
+    pthread_mutex_unlock(&savestate->lock);
+}
+
+/* true if filename is queued or being written, never waits for the write */
+bool
+savestate_writing(savestate_t *savestate, const char *filename)
+{
+    bool writing;
+
+    pthread_mutex_lock(&savestate->lock);
+    writing = (savestate->pending && strcmp(savestate->filename, filename) == 0)
+        || (savestate->busy && strcmp(savestate->writing, filename) == 0);
+    pthread_mutex_unlock(&savestate->lock);
+
+    return writing;
+}
+
+/* wait for a free buffer of at least size bytes, returns its index */
+static int
+_savestate_acquire(savestate_t *savestate, size_t size, const char *filename)
+{
+    int fill;
+
+    if (!savestate->running || size == 0)
+        return -1;
+
+    /* a truncated name would write somewhere else */
+    if (strlen(filename) >= sizeof(savestate->filename))
+    {
+        error("savestate", "path too long '%s'", filename);
+        return -1;
+    }
+
+    /* the fill buffer is free once the previous save is picked up */
+    pthread_mutex_lock(&savestate->lock);
+    while (savestate->pending)
+        pthread_cond_wait(&savestate->cond, &savestate->lock);
+    fill = savestate->fill;
+    pthread_mutex_unlock(&savestate->lock);
+
+    if (_savestate_reserve(&savestate->buffers[fill], &savestate->capacity[fill], size) != 0)
+        return -1;
+
+    return fill;
+}
+
+static void
+_savestate_queue(savestate_t *savestate, int fill, size_t size, const char *filename,
+                 bool compress, uint64_t serialize_ns)
+{
+    pthread_mutex_lock(&savestate->lock);
+    savestate->job = savestate->buffers[fill];
+    savestate->job_size = size;
+    savestate->job_compress = compress;
+    savestate->job_serialize_ns = serialize_ns;
+    snprintf(savestate->filename, sizeof(savestate->filename), "%s", filename);
+    savestate->pending = true;
+    savestate->fill = fill ^ 1;
+    pthread_cond_broadcast(&savestate->cond);
+    pthread_mutex_unlock(&savestate->lock);
+}
+
+int
+savestate_save(savestate_t *savestate, core_t *core, const char *filename)
+{
+    int fill;
+    size_t size;
+    uint64_t start;
+
+    size = core->api.retro_serialize_size();
+    fill = _savestate_acquire(savestate, size, filename);
+    if (fill < 0)
+        return 1;
+
+    start = _savestate_now();
+    if (!core->api.retro_serialize(savestate->buffers[fill], size))
+        return 1;
+
+    _savestate_queue(savestate, fill, size, filename, true, _savestate_now() - start);
+    return 0;
+}
+
+int
+savestate_write(savestate_t *savestate, const void *data, size_t size, const char *filename)
+{
+    int fill;
+
+    fill = _savestate_acquire(savestate, size, filename);
+    if (fill < 0)
+        return 1;
+
+    memcpy(savestate->buffers[fill], data, size);
+    _savestate_queue(savestate, fill, size, filename, false, 0);
+    return 0;
+}
+
+int
+savestate_load(savestate_t *savestate, core_t *core, const char *filename)
+{
+    int fd, res;
+    struct stat st;
+    uint8_t *map;
+    uint8_t *state;
+    size_t size;
+    uint64_t start;
+    savestate_header_t hdr;
+
+    /* the state may still be in flight */
+    savestate_flush(savestate);
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+
+    res = 1;
+    start = _savestate_now();
+
+    if (st.st_size < sizeof(hdr) || memcmp(map, SAVESTATE_MAGIC, 4) != 0)
+    {
+        /* uncompressed state written by older versions */
+        state = map;
+        size = st.st_size;
+    }
+    else
+    {
+        memcpy(&hdr, map, sizeof(hdr));
+        hdr.version = le32toh(hdr.version);
+        hdr.size = le32toh(hdr.size);
+        hdr.compressed_size = le32toh(hdr.compressed_size);
+
+        if (hdr.version != SAVESTATE_VERSION
+            || hdr.compressed_size > st.st_size - sizeof(hdr))
+        {
+            error("savestate", "'%s' is not a valid state file", filename);
+            goto out;
+        }
+
+        size = hdr.size;
+        if (_savestate_reserve(&savestate->buffers[savestate->fill],
+                               &savestate->capacity[savestate->fill], size) != 0)
+            goto out;
+
+        state = savestate->buffers[savestate->fill];
+        if (compress_lz_decode(map + sizeof(hdr), hdr.compressed_size, state, size) != 0)
+        {
+            error("savestate", "'%s' is corrupt", filename);
+            goto out;
+        }
+    }
+
+    if (!core->api.retro_unserialize(state, size))
+        goto out;
+
+    notice("savestate", "loaded %zu bytes from '%s' in %.3f ms",
+           size, filename, (_savestate_now() - start) / 1e6);
+    res = 0;
+
+out:
+    munmap(map, st.st_size);
+    return res;
+}
+
+/*
+ * State file of a rom slot, named after the rom with the crc32 of its
+ * full path added so equally named roms in different directories do
+ * not share slots.
+ */
+void
+savestate_path(char *path, size_t size, const char *directory,
+               const char *rom_path, int slot)
+{
+    const char *basename;
+    uint32_t key;
+
+    basename = strrchr(rom_path, '/');
+    basename = basename ? basename + 1 : rom_path;
+    key = crc32_update(0, rom_path, strlen(rom_path));
+
+    if (slot == SAVESTATE_SLOT_AUTO)
+        snprintf(path, size, "%s/%s.%08x.auto.state", directory, basename, key);
+    else
+        snprintf(path, size, "%s/%s.%08x.%d.state", directory, basename, key, slot);
+}
@@ -0,0 +1,90 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _savestate_h
+#define _savestate_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "core.h"
+
+#define SAVESTATE_MAGIC "HJST"
+#define SAVESTATE_VERSION 1
+
+/* slot used for automatic suspend states */
+#define SAVESTATE_SLOT_AUTO -1
+
+typedef struct savestate_header_t {
+    uint8_t magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t compressed_size;
+} savestate_header_t;
+
+/*
+ * Save state writer, serializes into one of two reusable buffers on the
+ * calling thread and hands it over to a writer thread which compresses
+ * and atomically replaces the state file. Serializing into the other
+ * buffer only waits if a previous save still has not been picked up.
+ * Raw memory regions such as SRAM are written through the same thread
+ * without compression.
+ */
+typedef struct savestate_t {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running;
+    bool pending;
+    bool busy;
+
+    uint8_t *buffers[2];
+    size_t capacity[2];
+    int fill;
+
+    /* save handed over to the writer thread */
+    uint8_t *job;
+    size_t job_size;
+    bool job_compress;
+    uint64_t job_serialize_ns;
+    char filename[4096];
+
+    /* file of the save being written, set while busy */
+    char writing[4096];
+
+    /* owned by the writer thread */
+    uint8_t *compressed;
+    size_t compressed_capacity;
+} savestate_t;
+
+int savestate_init(savestate_t *savestate);
+void savestate_deinit(savestate_t *savestate);
+int savestate_save(savestate_t *savestate, core_t *core, const char *filename);
+int savestate_write(savestate_t *savestate, const void *data, size_t size, const char *filename);
+int savestate_load(savestate_t *savestate, core_t *core, const char *filename);
+void savestate_flush(savestate_t *savestate);
+bool savestate_writing(savestate_t *savestate, const char *filename);
+void savestate_path(char *path, size_t size, const char *directory,
+                    const char *rom_path, int slot);
+
+#endif /* _savestate_h */
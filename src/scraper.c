@@ -19,133 +19,499 @@
  *
  */
 
+#include <ctype.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <strings.h>
 #include <memory.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "logger.h"
+#include "crc32.h"
+#include "hash.h"
+#include "zip.h"
+#include "dat.h"
 #include "scraper.h"
 
-static bool
-_scraper_db_has_rom_table(scraper_t *scraper)
+/* bump when the roms table changes, it is rebuilt by the next scan */
+#define SCRAPER_SCHEMA_VERSION 7
+
+static int
+_scraper_db_schema_version(scraper_t *scraper)
 {
-  int res;
-  res = sqlite3_exec(scraper->db,
-		   "SELECT * FROM roms",
-		     NULL, NULL, NULL);
-  if (res == SQLITE_OK)
-    return true;
+  int version = 0;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(scraper->db, "PRAGMA user_version", -1, &stmt, NULL) != SQLITE_OK)
+    return 0;
 
-  return false;
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    version = sqlite3_column_int(stmt, 0);
+
+  sqlite3_finalize(stmt);
+  return version;
 }
 
 static int
 _scraper_db_create_rom_table(scraper_t *scraper)
 {
   int res;
+  char query[64];
+
+  if (_scraper_db_schema_version(scraper) == SCRAPER_SCHEMA_VERSION)
+    return 0;
+
+  notice("scraper", "creating roms table, schema version %d", SCRAPER_SCHEMA_VERSION);
+
+  /*
+   * roms_fts is a trigram index of names, deletes and renames reach it
+   * by triggers while new rows are indexed in bulk by the scan.
+   */
   res = sqlite3_exec(scraper->db,
+		     "DROP TABLE IF EXISTS roms_fts;"		\
+		     "DROP TABLE IF EXISTS roms;"		\
 		     "CREATE TABLE roms ("			\
 		     " path        TEXT UNIQUE,"		\
 		     " name        TEXT,"			\
 		     " description TEXT,"			\
-		     " crc32       INTEGER UNIQUE,"		\
-		     " core        TEXT"			\
-		     ");", NULL, NULL, NULL);
+		     " crc32       INTEGER,"			\
+		     " core        TEXT,"			\
+		     " size        INTEGER,"			\
+		     " rom_size    INTEGER,"			\
+		     " mtime       INTEGER,"			\
+		     " system      INTEGER,"			\
+		     " header_name TEXT,"			\
+		     " file_name   TEXT,"			\
+		     " title       TEXT,"			\
+		     " region      TEXT,"			\
+		     " system_name TEXT,"			\
+		     " sort_key    TEXT"			\
+		     ");"					\
+		     "CREATE INDEX roms_sort ON roms(sort_key, path);"	\
+		     "CREATE VIRTUAL TABLE roms_fts USING fts5("	\
+		     " name, content='roms', content_rowid='rowid',"	\
+		     " tokenize='trigram');"			\
+		     "CREATE TRIGGER roms_fts_delete AFTER DELETE ON roms BEGIN" \
+		     " INSERT INTO roms_fts(roms_fts, rowid, name)"	\
+		     "  VALUES ('delete', old.rowid, old.name);"	\
+		     " END;"					\
+		     "CREATE TRIGGER roms_fts_update AFTER UPDATE OF name ON roms BEGIN" \
+		     " INSERT INTO roms_fts(roms_fts, rowid, name)"	\
+		     "  VALUES ('delete', old.rowid, old.name);"	\
+		     " INSERT INTO roms_fts(rowid, name) VALUES (new.rowid, new.name);" \
+		     " END;", NULL, NULL, NULL);
 
   if (res != SQLITE_OK)
   {
     return 1;
   }
 
+  snprintf(query, sizeof(query), "PRAGMA user_version = %d", SCRAPER_SCHEMA_VERSION);
+  if (sqlite3_exec(scraper->db, query, NULL, NULL, NULL) != SQLITE_OK)
+    return 1;
+
   return 0;
 }
 
+/* roms of imported DAT files, looked up by crc when a rom is added */
 static int
-_scraper_db_add_rom(scraper_t *scraper, core_t *core, const char *filename, const char *name)
+_scraper_db_create_dat_table(scraper_t *scraper)
 {
-  sqlite3_stmt *insert_stmt;
-  char query[512]={0};
+  int res;
+  res = sqlite3_exec(scraper->db,
+		     "CREATE TABLE IF NOT EXISTS dat_entries ("	\
+		     " crc32       INTEGER,"			\
+		     " size        INTEGER,"			\
+		     " title       TEXT,"			\
+		     " region      TEXT,"			\
+		     " system      TEXT,"			\
+		     " game        TEXT,"			\
+		     " rom         TEXT,"			\
+		     " dat         TEXT"			\
+		     ");"					\
+		     "CREATE INDEX IF NOT EXISTS dat_entries_crc32"	\
+		     " ON dat_entries(crc32, size);", NULL, NULL, NULL);
 
-  debug("adding rom: '%s'", filename);
+  if (res != SQLITE_OK)
+  {
+    return 1;
+  }
+
+  return 0;
+}
 
-  strcat(query, "INSERT INTO roms(path, core, name) VALUES(?, ?, ?)");
+static int
+_scraper_db_create_state_table(scraper_t *scraper)
+{
+  int res;
+  res = sqlite3_exec(scraper->db,
+		     "CREATE TABLE IF NOT EXISTS states ("	\
+		     " rom_path     TEXT,"			\
+		     " slot         INTEGER,"			\
+		     " timestamp    INTEGER,"			\
+		     " size         INTEGER,"			\
+		     " core         TEXT,"			\
+		     " core_version TEXT,"			\
+		     " PRIMARY KEY(rom_path, slot)"		\
+		     ");", NULL, NULL, NULL);
 
-  if (sqlite3_prepare_v2(scraper->db, query, sizeof(query), &insert_stmt, NULL) != SQLITE_OK)
+  if (res != SQLITE_OK)
   {
     return 1;
   }
 
-  sqlite3_bind_text(insert_stmt, 1, filename, -1, SQLITE_STATIC);
-  sqlite3_bind_text(insert_stmt, 2, core->name, -1, SQLITE_STATIC);
-  sqlite3_bind_text(insert_stmt, 3, name, -1, SQLITE_STATIC);
-
+  return 0;
+}
 
-  if (sqlite3_step(insert_stmt) != SQLITE_OK)
+static int
+_scraper_db_exec(scraper_t *scraper, const char *sql)
+{
+  if (sqlite3_exec(scraper->db, sql, NULL, NULL, NULL) != SQLITE_OK)
   {
-    sqlite3_finalize(insert_stmt);
+    error("scraper", "'%s' failed: %s", sql, sqlite3_errmsg(scraper->db));
     return 1;
   }
 
-  sqlite3_finalize(insert_stmt);
   return 0;
 }
 
 #define safe_strdup(str) (str?strdup((char *)str):NULL)
 
+static int64_t
+_scraper_mtime(const struct stat *st)
+{
+  return st->st_mtim.tv_sec * 1000000000ll + st->st_mtim.tv_nsec;
+}
+
+static scraper_known_t *
+_scraper_known_lookup(scraper_t *scraper, const char *path)
+{
+  size_t i;
+  scraper_known_t *known;
+
+  if (scraper->known_slots == NULL)
+    return NULL;
+
+  i = hash64(path, strlen(path), 0) & scraper->known_mask;
+  for (; scraper->known_slots[i] != 0; i = (i + 1) & scraper->known_mask)
+  {
+    known = &scraper->known[scraper->known_slots[i] - 1];
+    if (strcmp(known->path, path) == 0)
+      return known;
+  }
+
+  return NULL;
+}
+
+static void
+_scraper_known_free(scraper_t *scraper)
+{
+  size_t i;
+
+  for (i = 0; i < scraper->known_count; i++)
+  {
+    free(scraper->known[i].path);
+    free(scraper->known[i].core);
+  }
+
+  free(scraper->known);
+  free(scraper->known_slots);
+  scraper->known = NULL;
+  scraper->known_slots = NULL;
+  scraper->known_count = 0;
+}
+
+/*
+ * Load the size and mtime fingerprint of every rom below directory so
+ * that a rescan only has to stat files, not open and identify them.
+ */
 static int
-_scraper_db_get_list(scraper_t *scraper, uint32_t offset, uint32_t limit,
-                    scraper_rom_entry_t *result, size_t *size)
+_scraper_known_load(scraper_t *scraper, const char *directory)
 {
-    int rc;
-    size_t s;
-    sqlite3_stmt *get_list_stmt;
-    char query[512] = {};
+  size_t i, capacity, slots;
+  char lower[4096], upper[4096];
+  scraper_known_t *known;
+  sqlite3_stmt *stmt;
+  const char *query = "SELECT path, core, size, mtime FROM roms WHERE path > ? AND path < ?";
+
+  if (sqlite3_prepare_v2(scraper->db, query, -1, &stmt, NULL) != SQLITE_OK)
+    return 1;
 
-    strcat (query, "SELECT path,name,core FROM roms ORDER BY name LIMIT ? OFFSET ?");
+  /* every path starting with "directory/", '0' follows '/' */
+  snprintf(lower, sizeof(lower), "%s/", directory);
+  snprintf(upper, sizeof(upper), "%s0", directory);
+  sqlite3_bind_text(stmt, 1, lower, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, upper, -1, SQLITE_STATIC);
 
-    if (sqlite3_prepare_v2(scraper->db, query, sizeof(query), &get_list_stmt, NULL) != SQLITE_OK)
+  capacity = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    if (scraper->known_count == capacity)
     {
-        return 1;
+      capacity = capacity ? capacity * 2 : 1024;
+      known = realloc(scraper->known, capacity * sizeof(scraper_known_t));
+      if (known == NULL)
+        goto fail;
+      scraper->known = known;
     }
 
-    sqlite3_bind_int(get_list_stmt, 1, limit);
-    sqlite3_bind_int(get_list_stmt, 2, offset);
+    known = &scraper->known[scraper->known_count++];
+    known->path = safe_strdup(sqlite3_column_text(stmt, 0));
+    known->core = safe_strdup(sqlite3_column_text(stmt, 1));
+    known->size = sqlite3_column_int64(stmt, 2);
+    known->mtime = sqlite3_column_int64(stmt, 3);
+    known->seen = false;
+  }
 
-    s = *size;
-    *size = 0;
+  sqlite3_finalize(stmt);
 
-    while((rc = sqlite3_step(get_list_stmt) == SQLITE_ROW) && *size < s)
-    {
-        result[*size].path = safe_strdup(sqlite3_column_text(get_list_stmt, 0));
-        result[*size].name = safe_strdup(sqlite3_column_text(get_list_stmt, 1));
-        result[*size].core = safe_strdup(sqlite3_column_text(get_list_stmt, 2));
+  /* open addressed index at most half full, slots hold index + 1 */
+  for (slots = 64; slots < scraper->known_count * 2; slots *= 2)
+    ;
 
-        (*size)++;
-    }
+  scraper->known_slots = calloc(slots, sizeof(uint32_t));
+  if (scraper->known_slots == NULL)
+    goto out;
+  scraper->known_mask = slots - 1;
+
+  for (i = 0; i < scraper->known_count; i++)
+  {
+    size_t slot = hash64(scraper->known[i].path, strlen(scraper->known[i].path), 0)
+      & scraper->known_mask;
+    while (scraper->known_slots[slot] != 0)
+      slot = (slot + 1) & scraper->known_mask;
+    scraper->known_slots[slot] = i + 1;
+  }
+
+  return 0;
+
+fail:
+  sqlite3_finalize(stmt);
+out:
+  _scraper_known_free(scraper);
+  return 1;
+}
 
-    sqlite3_finalize(get_list_stmt);
+/* remove rows of roms that were not seen by the scan */
+static void
+_scraper_known_prune(scraper_t *scraper)
+{
+  size_t i;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(scraper->db, "DELETE FROM roms WHERE path = ?", -1, &stmt, NULL) != SQLITE_OK)
+    return;
+
+  for (i = 0; i < scraper->known_count; i++)
+  {
+    if (scraper->known[i].seen)
+      continue;
+
+    sqlite3_bind_text(stmt, 1, scraper->known[i].path, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_DONE)
+      scraper->removed++;
+    sqlite3_reset(stmt);
+  }
+
+  sqlite3_finalize(stmt);
+
+  if (scraper->removed)
+    notice("scraper", "removed %u roms no longer present", scraper->removed);
+}
+
+static int64_t
+_scraper_db_max_rowid(scraper_t *scraper)
+{
+  int64_t rowid = 0;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(scraper->db, "SELECT max(rowid) FROM roms", -1, &stmt, NULL) != SQLITE_OK)
     return 0;
+
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    rowid = sqlite3_column_int64(stmt, 0);
+
+  sqlite3_finalize(stmt);
+  return rowid;
 }
 
+/*
+ * Add rows inserted since the last call to roms_fts. A trigger per
+ * inserted row makes fts5 flush a segment for every row, which took
+ * an initial scan of 6000 roms from 0.12 s to 0.35 s; one INSERT ...
+ * SELECT per batch indexes the same rows in a single pass. New rows
+ * always get a rowid above the current maximum so the high water mark
+ * finds them.
+ */
+static int
+_scraper_db_index_new_roms(scraper_t *scraper)
+{
+  int rc;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(scraper->db,
+                         "INSERT INTO roms_fts(rowid, name)" \
+                         " SELECT rowid, name FROM roms WHERE rowid > ?1",
+                         -1, &stmt, NULL) != SQLITE_OK)
+  {
+    warning("scraper", "failed to prepare search index: %s", sqlite3_errmsg(scraper->db));
+    return 1;
+  }
+
+  sqlite3_bind_int64(stmt, 1, scraper->fts_rowid);
+  rc = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  if (rc != SQLITE_DONE)
+  {
+    warning("scraper", "failed to update search index: %s", sqlite3_errmsg(scraper->db));
+    return 1;
+  }
+
+  scraper->fts_rowid = _scraper_db_max_rowid(scraper);
+  return 0;
+}
+
+/*
+ * Scans run inside batched transactions with one prepared insert
+ * statement, committing every SCRAPER_BATCH_SIZE rows instead of
+ * syncing each row to disk.
+ */
+static int
+_scraper_db_begin_scan(scraper_t *scraper, const char *directory)
+{
+  /*
+   * canonical title, region and system are joined in from the DAT by
+   * crc and size of the payload, the latest imported entry wins
+   */
+  const char *query =
+    "INSERT INTO roms(path, core, file_name, size, mtime, system, header_name, crc32," \
+    " rom_size, name, title, region, system_name, sort_key)" \
+    " SELECT ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, coalesce(d.title, ?3), d.title, d.region," \
+    " d.system, lower(coalesce(d.title, ?3))" \
+    " FROM (SELECT 1) LEFT JOIN dat_entries d ON d.crc32 = ?8 AND d.size = ?9" \
+    " WHERE true ORDER BY d.rowid DESC LIMIT 1" \
+    " ON CONFLICT(path) DO UPDATE SET core=excluded.core, file_name=excluded.file_name," \
+    " size=excluded.size, rom_size=excluded.rom_size, mtime=excluded.mtime," \
+    " system=excluded.system," \
+    " header_name=excluded.header_name, crc32=excluded.crc32, name=excluded.name," \
+    " title=excluded.title, region=excluded.region, system_name=excluded.system_name," \
+    " sort_key=excluded.sort_key";
+
+  if (_scraper_known_load(scraper, directory) != 0)
+    warning("scraper", "failed to load known roms, rescanning all");
+
+  if (sqlite3_prepare_v2(scraper->db, query, -1, &scraper->add_rom_stmt, NULL) != SQLITE_OK)
+  {
+    error("scraper", "failed to prepare insert: %s", sqlite3_errmsg(scraper->db));
+    _scraper_known_free(scraper);
+    return 1;
+  }
+
+  scraper->batch = 0;
+  scraper->rows = 0;
+  scraper->unchanged = 0;
+  scraper->removed = 0;
+  scraper->fts_rowid = _scraper_db_max_rowid(scraper);
+  return _scraper_db_exec(scraper, "BEGIN");
+}
+
+static void
+_scraper_db_end_scan(scraper_t *scraper, bool complete)
+{
+  _scraper_db_index_new_roms(scraper);
+
+  /* only a complete walk knows which roms are gone */
+  if (complete)
+    _scraper_known_prune(scraper);
+
+  _scraper_db_exec(scraper, "COMMIT");
+  sqlite3_finalize(scraper->add_rom_stmt);
+  scraper->add_rom_stmt = NULL;
+  _scraper_known_free(scraper);
+}
+
+static int
+_scraper_db_add_rom(scraper_t *scraper, core_t *core, const char *filename, const char *name,
+                    const struct stat *st, const romident_rom_data_t *rom, uint32_t crc)
+{
+  int rc;
+  sqlite3_stmt *insert_stmt = scraper->add_rom_stmt;
+
+  debug("adding rom: '%s'", filename);
+
+  sqlite3_bind_text(insert_stmt, 1, filename, -1, SQLITE_STATIC);
+  sqlite3_bind_text(insert_stmt, 2, core->name, -1, SQLITE_STATIC);
+  sqlite3_bind_text(insert_stmt, 3, name, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(insert_stmt, 4, st->st_size);
+  sqlite3_bind_int64(insert_stmt, 5, _scraper_mtime(st));
+  sqlite3_bind_int(insert_stmt, 6, rom->system);
+  sqlite3_bind_text(insert_stmt, 7, (const char *)rom->name, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(insert_stmt, 8, crc);
+  sqlite3_bind_int64(insert_stmt, 9, st->st_size - (off_t)rom->header_size);
+
+  rc = sqlite3_step(insert_stmt);
+  sqlite3_reset(insert_stmt);
+  sqlite3_clear_bindings(insert_stmt);
+
+  if (rc != SQLITE_DONE)
+  {
+    warning("scraper", "failed to add rom '%s': %s", filename, sqlite3_errmsg(scraper->db));
+    return 1;
+  }
+
+  scraper->rows++;
+  if (++scraper->batch == SCRAPER_BATCH_SIZE)
+  {
+    scraper->batch = 0;
+    if (_scraper_db_index_new_roms(scraper) != 0
+        || _scraper_db_exec(scraper, "COMMIT") != 0 || _scraper_db_exec(scraper, "BEGIN") != 0)
+      return 1;
+  }
+
+  return 0;
+}
 
 int
-scraper_init(scraper_t *scraper)
+scraper_init(scraper_t *scraper, const char *database)
 {
   memset(scraper, 0, sizeof(scraper_t));
 
   romident_init(&scraper->ident);
 
-  if (sqlite3_open("./hjortron.db", &scraper->db) != SQLITE_OK)
+  if (sqlite3_open(database, &scraper->db) != SQLITE_OK)
   {
     error("scraper", "failed to open/create database");
     return 1;
   }
 
-  if (!_scraper_db_has_rom_table(scraper))
+  /* rescans write through a connection of their own while the ui reads */
+  sqlite3_busy_timeout(scraper->db, 5000);
+  if (sqlite3_exec(scraper->db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL) != SQLITE_OK)
+    warning("scraper", "failed to enable write-ahead log: %s", sqlite3_errmsg(scraper->db));
+
+  if (_scraper_db_create_rom_table(scraper) != 0)
+  {
+    error("scraper", "failed to create roms table");
+    return 1;
+  }
+
+  if (_scraper_db_create_dat_table(scraper) != 0)
   {
-    if (_scraper_db_create_rom_table(scraper) != 0)
-      return 1;
+    error("scraper", "failed to create dat_entries table");
+    return 1;
+  }
+
+  if (_scraper_db_create_state_table(scraper) != 0)
+  {
+    error("scraper", "failed to create states table");
+    return 1;
   }
 
   return 0;
@@ -157,153 +523,874 @@ scraper_deinit(scraper_t *scraper)
   sqlite3_close(scraper->db);
 }
 
-static bool
-_scraper_file_match_extensions(const char *filename, const char *extensions)
+/* first candidate core for the file extension of filename */
+static core_t *
+_scraper_find_core(core_collection_t *cores, const char *filename)
 {
-    char ext[64];
-    const char *ps, *pd;
+    size_t count;
+    core_t **candidates;
+    const char *ext;
 
-    if (extensions == NULL)
-        return false;
+    ext = strrchr(filename, '.');
+    if (ext == NULL)
+        return NULL;
 
-    ps = strrchr(filename, '.');
-    if (ps == NULL)
-        return false;
+    candidates = core_collection_get_by_extension(cores, ext + 1, &count);
+    return (count > 0) ? candidates[0] : NULL;
+}
 
-    snprintf(ext, sizeof(ext), "%s", ps + 1);
+#define SCRAPER_QUEUE_SIZE 256
+#define SCRAPER_WORKERS_MAX 16
+
+enum {
+  SCRAPER_JOB_PENDING,
+  SCRAPER_JOB_DONE,
+  SCRAPER_JOB_FAILED,
+};
+
+typedef struct scraper_job_t {
+  char *path;
+  char *name;
+  core_t *core;
+  struct stat st;
+  romident_rom_data_t rom;
+  uint32_t crc;
+  /* archive member, identified from the zip directory and its first bytes */
+  bool archived;
+  zip_entry_t member;
+  int state;
+} scraper_job_t;
+
+typedef struct scraper_payload_t {
+  uint32_t skip;
+  uint32_t crc;
+} scraper_payload_t;
 
-    ps = extensions;
-    while(*ps != '\0')
-    {
-        pd = ext;
+static int
+_scraper_payload_cb(void *opaque, const uint8_t *data, size_t len)
+{
+  scraper_payload_t *payload = opaque;
 
-        /* compare ext with entry */
-        while(*ps != '\0' && *ps != '|')
-        {
-            if (*pd == '\0')
-                break;
+  if (len <= payload->skip)
+  {
+    payload->skip -= len;
+    return 0;
+  }
 
-            if (*ps == '|')
-                break;
+  payload->crc = crc32_update(payload->crc, data + payload->skip, len - payload->skip);
+  payload->skip = 0;
+  return 0;
+}
 
-            if (*ps != *pd)
-                break;
+/*
+ * The directory crc of a member covers any copier header, a headered
+ * member is inflated to crc its payload the same way as a plain file.
+ */
+static int
+_scraper_crc_member(scraper_job_t *job)
+{
+  char archive[4096];
+  uint8_t head[16];
+  size_t len = sizeof(head);
+  scraper_payload_t payload = { 0, 0 };
 
-            ps++;
-            pd++;
-        }
+  memset(&job->rom, 0, sizeof(job->rom));
+  job->crc = job->member.crc32;
 
-        /* do we have a matching extension */
-        if (*pd == '\0' && *ps == '|')
-            return true;
+  if (zip_member(job->path, archive, sizeof(archive)) == NULL)
+    return 1;
+
+  if (zip_read_head(archive, &job->member, head, &len) != 0)
+    return 0;
 
-        /* advance to next extension for matching */
-        while(*ps != '\0' && *ps != '|')
-            ps++;
+  job->rom.header_size = romident_header_size(job->member.name, head, len, job->member.size);
+  if (job->rom.header_size == 0)
+    return 0;
+
+  if (job->rom.header_size == 16)
+    job->rom.system = ROMIDENT_NES;
+
+  payload.skip = job->rom.header_size;
+  if (zip_read(archive, &job->member, _scraper_payload_cb, &payload) != 0)
+    return 1;
 
-        if (*ps == '|')
-            ps++;
+  job->crc = payload.crc;
+  return 0;
+}
+
+/*
+ * Scan pipeline, the calling thread walks the tree in sorted order and
+ * queues files into a bounded ring, workers identify and CRC them out
+ * of order and a single writer inserts them in queue order, so the
+ * database contents do not depend on the number of workers.
+ */
+typedef struct scraper_pipeline_t {
+  scraper_t *scraper;
+  pthread_mutex_t lock;
+  pthread_cond_t queued;
+  pthread_cond_t processed;
+  pthread_cond_t retired;
+  scraper_job_t jobs[SCRAPER_QUEUE_SIZE];
+  uint64_t produced;
+  uint64_t claimed;
+  uint64_t written;
+  bool finished;
+} scraper_pipeline_t;
+
+static void *
+_scraper_pipeline_worker(void *opaque)
+{
+  int state;
+  uint64_t seq;
+  scraper_job_t *job;
+  scraper_pipeline_t *pipeline = opaque;
+
+  pthread_mutex_lock(&pipeline->lock);
+  for (;;)
+  {
+    while (pipeline->claimed == pipeline->produced && !pipeline->finished)
+      pthread_cond_wait(&pipeline->queued, &pipeline->lock);
+
+    if (pipeline->claimed == pipeline->produced)
+      break;
+
+    seq = pipeline->claimed++;
+    job = &pipeline->jobs[seq % SCRAPER_QUEUE_SIZE];
+    pthread_mutex_unlock(&pipeline->lock);
+
+    state = SCRAPER_JOB_DONE;
+    if (job->archived)
+    {
+      if (_scraper_crc_member(job) != 0)
+        state = SCRAPER_JOB_FAILED;
     }
+    else if (romident_identify(&pipeline->scraper->ident, job->path, &job->rom) != 0
+             || crc32_file_from(job->path, job->rom.header_size, &job->crc) != 0)
+      state = SCRAPER_JOB_FAILED;
+
+    pthread_mutex_lock(&pipeline->lock);
+    job->state = state;
+    pthread_cond_signal(&pipeline->processed);
+  }
+  pthread_mutex_unlock(&pipeline->lock);
+
+  return NULL;
+}
+
+static void *
+_scraper_pipeline_writer(void *opaque)
+{
+  scraper_job_t *job;
+  scraper_pipeline_t *pipeline = opaque;
+
+  pthread_mutex_lock(&pipeline->lock);
+  for (;;)
+  {
+    job = &pipeline->jobs[pipeline->written % SCRAPER_QUEUE_SIZE];
+    while ((pipeline->written == pipeline->produced && !pipeline->finished)
+           || (pipeline->written < pipeline->produced && job->state == SCRAPER_JOB_PENDING))
+      pthread_cond_wait(&pipeline->processed, &pipeline->lock);
+
+    if (pipeline->written == pipeline->produced)
+      break;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    if (job->state == SCRAPER_JOB_DONE)
+      _scraper_db_add_rom(pipeline->scraper, job->core, job->path, job->name,
+                          &job->st, &job->rom, job->crc);
+
+    free(job->path);
+    free(job->name);
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->written++;
+    pthread_cond_signal(&pipeline->retired);
+  }
+  pthread_mutex_unlock(&pipeline->lock);
+
+  return NULL;
+}
+
+static void
+_scraper_pipeline_push(scraper_pipeline_t *pipeline, const char *path, const char *filename,
+                       core_t *core, const struct stat *st, const zip_entry_t *member)
+{
+  char *ps;
+  scraper_job_t *job;
+
+  pthread_mutex_lock(&pipeline->lock);
+  while (pipeline->produced - pipeline->written == SCRAPER_QUEUE_SIZE)
+    pthread_cond_wait(&pipeline->retired, &pipeline->lock);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  /* the slot is owned by the walker until produced is advanced */
+  job = &pipeline->jobs[pipeline->produced % SCRAPER_QUEUE_SIZE];
+  job->path = strdup(path);
+  job->name = strdup(filename);
+  ps = strrchr(job->name, '.');
+  if (ps)
+    *ps = '\0';
+  job->core = core;
+  job->st = *st;
+  job->archived = false;
+  job->state = SCRAPER_JOB_PENDING;
+
+  if (member)
+  {
+    job->st.st_size = member->size;
+    job->member = *member;
+    job->archived = true;
+  }
 
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->produced++;
+  pthread_cond_signal(&pipeline->queued);
+  pthread_mutex_unlock(&pipeline->lock);
+}
+
+/* true if the rom was seen by an earlier scan and has not changed */
+static bool
+_scraper_is_unchanged(scraper_t *scraper, const char *path, core_t *core,
+                      int64_t size, int64_t mtime)
+{
+  scraper_known_t *known;
+
+  known = _scraper_known_lookup(scraper, path);
+  if (known == NULL)
+    return false;
+
+  known->seen = true;
+  if (known->size != size || known->mtime != mtime
+      || known->core == NULL || strcmp(known->core, core->name) != 0)
     return false;
+
+  scraper->unchanged++;
+  return true;
+}
+
+/*
+ * Roms in a zip archive are listed from its central directory, the
+ * members are matched to cores by their own extension and only
+ * members with a copier header are inflated. The archive mtime stands
+ * in for the member mtime.
+ */
+static void
+_scraper_scan_archive(scraper_pipeline_t *pipeline, core_collection_t *cores,
+                      const char *archive, const struct stat *st)
+{
+  size_t i, count;
+  core_t *core;
+  char path[4096];
+  const char *name;
+  zip_entry_t *entries;
+
+  if (zip_read_directory(archive, &entries, &count) != 0)
+  {
+    warning("scraper", "failed to read zip directory of '%s'", archive);
+    return;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    core = _scraper_find_core(cores, entries[i].name);
+    if (core == NULL)
+      continue;
+
+    snprintf(path, sizeof(path), "%s%c%s", archive, ZIP_MEMBER_SEPARATOR, entries[i].name);
+    if (_scraper_is_unchanged(pipeline->scraper, path, core, entries[i].size, _scraper_mtime(st)))
+      continue;
+
+    name = strrchr(entries[i].name, '/');
+    name = name ? name + 1 : entries[i].name;
+    _scraper_pipeline_push(pipeline, path, name, core, st, &entries[i]);
+  }
+
+  free(entries);
+}
+
+static int
+_scraper_scan_directory(scraper_pipeline_t *pipeline, core_collection_t *cores,
+                        const char *directory)
+{
+  int i, count;
+  int res = 0;
+  core_t *core;
+  char path[4096];
+  struct stat st;
+  struct dirent **entries;
+  struct dirent *entry;
+  const char *ext;
+  scraper_t *scraper = pipeline->scraper;
+
+  /* sorted for a deterministic scan order */
+  count = scandir(directory, &entries, NULL, alphasort);
+  if (count < 0)
+    return 1;
+
+  for (i = 0; i < count; i++)
+  {
+    entry = entries[i];
+    snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+    if (entry->d_type == DT_DIR
+        && strcmp(entry->d_name,".") != 0
+        && strcmp(entry->d_name, "..") != 0)
+    {
+      /* an unreadable subtree must not prune its roms */
+      if (_scraper_scan_directory(pipeline, cores, path) != 0)
+        res = 1;
+      continue;
+    }
+
+    if (entry->d_type != DT_REG)
+      continue;
+
+    /* look up which core that matches rom file */
+    core = _scraper_find_core(cores, entry->d_name);
+
+    /* zip files are archives unless a core loads them itself */
+    ext = strrchr(entry->d_name, '.');
+    if (core == NULL && ext && strcasecmp(ext, ".zip") == 0)
+    {
+      if (stat(path, &st) == 0)
+        _scraper_scan_archive(pipeline, cores, path, &st);
+      continue;
+    }
+
+    if (core == NULL)
+      continue;
+
+    if (stat(path, &st) != 0)
+      continue;
+
+    /* skip files unchanged since last scan */
+    if (_scraper_is_unchanged(scraper, path, core, st.st_size, _scraper_mtime(&st)))
+      continue;
+
+    _scraper_pipeline_push(pipeline, path, entry->d_name, core, &st, NULL);
+  }
+
+  for (i = 0; i < count; i++)
+    free(entries[i]);
+  free(entries);
+
+  return res;
+}
+
+static size_t
+_scraper_pipeline_workers(void)
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (cpus < 1)
+    return 1;
+
+  return (cpus > SCRAPER_WORKERS_MAX) ? SCRAPER_WORKERS_MAX : cpus;
+}
+
+static int
+_scraper_pipeline_run(scraper_t *scraper, core_collection_t *cores, const char *directory)
+{
+  int res;
+  size_t i, workers;
+  pthread_t writer;
+  pthread_t threads[SCRAPER_WORKERS_MAX];
+  scraper_pipeline_t *pipeline;
+
+  pipeline = calloc(1, sizeof(scraper_pipeline_t));
+  if (pipeline == NULL)
+    return 1;
+
+  pipeline->scraper = scraper;
+  pthread_mutex_init(&pipeline->lock, NULL);
+  pthread_cond_init(&pipeline->queued, NULL);
+  pthread_cond_init(&pipeline->processed, NULL);
+  pthread_cond_init(&pipeline->retired, NULL);
+
+  if (pthread_create(&writer, NULL, _scraper_pipeline_writer, pipeline) != 0)
+  {
+    res = 1;
+    goto out;
+  }
+
+  workers = _scraper_pipeline_workers();
+  for (i = 0; i < workers; i++)
+  {
+    if (pthread_create(&threads[i], NULL, _scraper_pipeline_worker, pipeline) != 0)
+      break;
+  }
+  workers = i;
+
+  res = 1;
+  if (workers > 0)
+    res = _scraper_scan_directory(pipeline, cores, directory);
+  else
+    error("scraper", "failed to start scan workers");
+
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->finished = true;
+  pthread_cond_broadcast(&pipeline->queued);
+  pthread_cond_broadcast(&pipeline->processed);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  for (i = 0; i < workers; i++)
+    pthread_join(threads[i], NULL);
+  pthread_join(writer, NULL);
+
+  debug("scan used %zu workers", workers);
+
+out:
+  pthread_cond_destroy(&pipeline->retired);
+  pthread_cond_destroy(&pipeline->processed);
+  pthread_cond_destroy(&pipeline->queued);
+  pthread_mutex_destroy(&pipeline->lock);
+  free(pipeline);
+  return res;
+}
+
+static uint64_t
+_scraper_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
 int
 scraper_scan_directory(scraper_t *scraper, core_collection_t *cores, const char *directory)
 {
-    int i;
-    DIR *dir;
-    core_t *core;
-    char path[4096];
-    struct dirent *entry;
+    int res;
+    uint64_t start;
+    double elapsed;
 
-    dir = opendir(directory);
-    if (dir == NULL)
+    if (_scraper_db_begin_scan(scraper, directory) != 0)
         return 1;
 
-    while ((entry = readdir(dir)) != NULL)
+    start = _scraper_now();
+    res = _scraper_pipeline_run(scraper, cores, directory);
+    _scraper_db_end_scan(scraper, res == 0);
+    elapsed = (_scraper_now() - start) / 1e9;
+
+    if (scraper->rows || scraper->removed)
+      scraper->generation++;
+
+    notice("scraper", "scanned %u roms in %.3f s, %.0f rows/s, %u unchanged",
+           scraper->rows, elapsed, elapsed > 0 ? scraper->rows / elapsed : 0.0,
+           scraper->unchanged);
+    return res;
+}
+
+typedef struct scraper_dat_import_t {
+  scraper_t *scraper;
+  sqlite3_stmt *stmt;
+  const char *filename;
+  uint32_t entries;
+} scraper_dat_import_t;
+
+static int
+_scraper_dat_add_entry(void *opaque, const dat_entry_t *entry)
+{
+  int rc;
+  scraper_dat_import_t *import = opaque;
+  sqlite3_stmt *stmt = import->stmt;
+
+  sqlite3_bind_int64(stmt, 1, entry->crc32);
+  sqlite3_bind_int64(stmt, 2, entry->size);
+  sqlite3_bind_text(stmt, 3, entry->title, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 4, entry->region, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 5, entry->system, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 6, entry->game, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 7, entry->rom, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 8, import->filename, -1, SQLITE_STATIC);
+
+  rc = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+
+  if (rc != SQLITE_DONE)
+    return 1;
+
+  import->entries++;
+  return 0;
+}
+
+/*
+ * Import a Logiqx XML DAT, replacing entries of an earlier import of
+ * the same file, and apply it to already scanned roms. The import is
+ * a single transaction so a malformed or truncated DAT leaves the
+ * earlier import in place.
+ */
+int
+scraper_import_dat(scraper_t *scraper, const char *filename)
+{
+  int res;
+  uint64_t start;
+  double elapsed;
+  sqlite3_stmt *stmt;
+  scraper_dat_import_t import = { scraper, NULL, filename, 0 };
+  const char *query =
+    "INSERT INTO dat_entries(crc32, size, title, region, system, game, rom, dat)" \
+    " VALUES(?, ?, ?, ?, ?, ?, ?, ?)";
+
+  start = _scraper_now();
+
+  if (_scraper_db_exec(scraper, "BEGIN") != 0)
+    return 1;
+
+  if (sqlite3_prepare_v2(scraper->db, "DELETE FROM dat_entries WHERE dat = ?", -1, &stmt, NULL) != SQLITE_OK)
+    goto fail;
+  sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_STATIC);
+  res = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  if (res != SQLITE_DONE)
+    goto fail;
+
+  if (sqlite3_prepare_v2(scraper->db, query, -1, &import.stmt, NULL) != SQLITE_OK)
+    goto fail;
+
+  res = dat_parse(filename, _scraper_dat_add_entry, &import);
+  sqlite3_finalize(import.stmt);
+  if (res != 0)
+    goto fail;
+
+  /*
+   * roms scanned before the import pick up their canonical names, of
+   * entries sharing crc and size the latest imported wins as in the scan
+   */
+  if (_scraper_db_exec(scraper,
+        "UPDATE roms SET name = d.title, title = d.title, region = d.region," \
+        " system_name = d.system, sort_key = lower(d.title)" \
+        " FROM (SELECT crc32, size, title, region, system, max(rowid)" \
+        "  FROM dat_entries GROUP BY crc32, size) d" \
+        " WHERE d.crc32 = roms.crc32 AND d.size = roms.rom_size") != 0)
+    goto fail;
+
+  if (sqlite3_changes(scraper->db) > 0)
+    scraper->generation++;
+
+  if (_scraper_db_exec(scraper, "COMMIT") != 0)
+    return 1;
+
+  elapsed = (_scraper_now() - start) / 1e9;
+  notice("scraper", "imported %u dat entries from '%s' in %.3f s, %.0f entries/s",
+         import.entries, filename, elapsed, elapsed > 0 ? import.entries / elapsed : 0.0);
+  return 0;
+
+fail:
+  error("scraper", "failed to import dat '%s'", filename);
+  _scraper_db_exec(scraper, "ROLLBACK");
+  return 1;
+}
+
+static int
+_scraper_db_get_page(scraper_t *scraper, const char *query, const char *key, const char *path,
+                     uint32_t limit, scraper_rom_entry_t *result, size_t *size)
+{
+    size_t s;
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(scraper->db, query, -1, &stmt, NULL) != SQLITE_OK)
     {
-        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        return 1;
+    }
 
-        if (entry->d_type == DT_DIR
-            && strcmp(entry->d_name,".") != 0
-            && strcmp(entry->d_name, "..") != 0)
-        {
-            scraper_scan_directory(scraper, cores, path);
-            continue;
-        }
+    sqlite3_bind_text(stmt, 1, key ? key : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, path ? path : "", -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, limit);
 
-        if (entry->d_type != DT_REG)
-            continue;
+    s = *size;
+    *size = 0;
+
+    while (*size < s && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        result[*size].path = safe_strdup(sqlite3_column_text(stmt, 0));
+        result[*size].name = safe_strdup(sqlite3_column_text(stmt, 1));
+        result[*size].core = safe_strdup(sqlite3_column_text(stmt, 2));
+        result[*size].key = safe_strdup(sqlite3_column_text(stmt, 3));
+
+        (*size)++;
+    }
+
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+/*
+ * Keyset pagination over the roms_sort index, a page is addressed by
+ * the (sort key, path) of a row instead of an offset so that fetching
+ * it costs the same anywhere in the list. An empty key and path is the
+ * start of the list, an empty path the first row of a key prefix.
+ */
+int
+scraper_get_from(scraper_t *scraper, const char *key, const char *path, uint32_t limit,
+                 scraper_rom_entry_t *result, size_t *size)
+{
+    return _scraper_db_get_page(scraper,
+        "SELECT path, name, core, sort_key FROM roms" \
+        " WHERE (sort_key, path) >= (?1, ?2) ORDER BY sort_key, path LIMIT ?3",
+        key, path, limit, result, size);
+}
+
+/* rows preceding (key, path), returned in list order */
+int
+scraper_get_before(scraper_t *scraper, const char *key, const char *path, uint32_t limit,
+                   scraper_rom_entry_t *result, size_t *size)
+{
+    size_t i;
+    scraper_rom_entry_t tmp;
+
+    if (_scraper_db_get_page(scraper,
+        "SELECT path, name, core, sort_key FROM roms" \
+        " WHERE (sort_key, path) < (?1, ?2) ORDER BY sort_key DESC, path DESC LIMIT ?3",
+        key, path, limit, result, size) != 0)
+        return 1;
+
+    for (i = 0; i < *size / 2; i++)
+    {
+        tmp = result[i];
+        result[i] = result[*size - 1 - i];
+        result[*size - 1 - i] = tmp;
+    }
+
+    return 0;
+}
 
-        /* look up which core that matches rom file */
-        core = NULL;
-        for (i = 0; i < core_collection_size(cores); i++)
+static int
+_scraper_search_deadline(void *opaque)
+{
+    return _scraper_now() > *(uint64_t *)opaque;
+}
+
+/*
+ * Substring search of rom names for type-to-search, three or more
+ * characters go through the roms_fts trigram index and shorter input
+ * is a prefix match on the sort key. The trigram query takes the first
+ * limit matches in index order and sorts only those, so its cost does
+ * not grow with the number of matches. A query still running after
+ * SCRAPER_SEARCH_BUDGET_MS is interrupted and sets search_interrupted,
+ * searches slower than SCRAPER_SEARCH_TARGET_MS are logged.
+ */
+int
+scraper_search(scraper_t *scraper, const char *text, uint32_t limit,
+               scraper_rom_entry_t *result, size_t *size)
+{
+    int res = SQLITE_DONE;
+    size_t s, chars;
+    char match[512];
+    uint64_t start, deadline;
+    double elapsed;
+    const char *p;
+    char *q;
+    sqlite3_stmt *stmt;
+    const char *query;
+
+    scraper->search_interrupted = false;
+
+    start = _scraper_now();
+    deadline = start + SCRAPER_SEARCH_BUDGET_MS * 1000000ull;
+
+    /* trigrams are of characters, skip utf-8 continuation bytes */
+    for (chars = 0, p = text; *p != '\0'; p++)
+        chars += ((uint8_t)*p & 0xc0) != 0x80;
+
+    if (chars >= 3)
+    {
+        /* quote as one fts5 string so that input is never query syntax */
+        q = match;
+        *q++ = '"';
+        for (p = text; *p != '\0' && q < match + sizeof(match) - 3; p++)
         {
-            if (_scraper_file_match_extensions(entry->d_name, cores->slots[i].valid_extensions) == true)
-            {
-                core = &cores->slots[i];
-                break;
-            }
+            if (*p == '"')
+                *q++ = '"';
+            *q++ = *p;
         }
+        *q++ = '"';
+        *q = '\0';
 
-        if (core == NULL)
-            continue;
+        query = "SELECT r.path, r.name, r.core, r.sort_key FROM" \
+                " (SELECT rowid FROM roms_fts WHERE roms_fts MATCH ?1 LIMIT ?2) f" \
+                " JOIN roms r ON r.rowid = f.rowid ORDER BY r.sort_key, r.path";
+    }
+    else
+    {
+        snprintf(match, sizeof(match), "%s", text);
+        for (q = match; *q != '\0'; q++)
+            *q = tolower((unsigned char)*q);
 
-        /* TODO: if file is zip, then scan content */
+        query = "SELECT path, name, core, sort_key FROM roms" \
+                " WHERE sort_key >= ?1 AND sort_key < ?1 || char(1114111)" \
+                " ORDER BY sort_key, path LIMIT ?2";
+    }
 
-        char *ps;
-        char name[1024];
-        snprintf(name, sizeof(name), "%s", entry->d_name);
-        ps = strrchr(name, '.');
-        if (ps)
-          *ps='\0';
+    if (sqlite3_prepare_v2(scraper->db, query, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        warning("scraper", "failed to prepare search: %s", sqlite3_errmsg(scraper->db));
+        return 1;
+    }
 
-        romident_rom_data_t rom;
-        if (romident_identify(&scraper->ident, path, &rom) != 0)
-          continue;
+    sqlite3_bind_text(stmt, 1, match, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, limit);
 
-        /* TODO: consider lookup rom in rdb by crc32 for additional info */
+    sqlite3_progress_handler(scraper->db, 1000, _scraper_search_deadline, &deadline);
+
+    s = *size;
+    *size = 0;
 
-        _scraper_db_add_rom(scraper, core, path, name);
+    while (*size < s && (res = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        result[*size].path = safe_strdup(sqlite3_column_text(stmt, 0));
+        result[*size].name = safe_strdup(sqlite3_column_text(stmt, 1));
+        result[*size].core = safe_strdup(sqlite3_column_text(stmt, 2));
+        result[*size].key = safe_strdup(sqlite3_column_text(stmt, 3));
+
+        (*size)++;
     }
 
-  return 0;
+    sqlite3_progress_handler(scraper->db, 0, NULL, NULL);
+    sqlite3_finalize(stmt);
+
+    elapsed = (_scraper_now() - start) / 1e6;
+
+    if (res == SQLITE_INTERRUPT)
+    {
+        scraper->search_interrupted = true;
+        warning("scraper", "search '%s' interrupted after %.2f ms, %zu results",
+                text, elapsed, *size);
+    }
+    else if (elapsed > SCRAPER_SEARCH_TARGET_MS)
+        notice("scraper", "search '%s': %zu results in %.2f ms, target is %u ms",
+               text, *size, elapsed, SCRAPER_SEARCH_TARGET_MS);
+    else
+        debug("search '%s': %zu results in %.2f ms", text, *size, elapsed);
+
+    return 0;
 }
 
-int
-scraper_get_list(scraper_t *scraper, uint32_t index, uint32_t limit,
-                    scraper_rom_entry_t *result, size_t *size)
+uint32_t
+scraper_bucket_of(const char *key)
 {
-    return _scraper_db_get_list(scraper, index, limit, result, size);
+    uint8_t ch = key ? (uint8_t)key[0] : 0;
+
+    if (ch < 'a')
+        return 0;
+    if (ch > 'z')
+        return SCRAPER_BUCKETS - 1;
+    return ch - 'a' + 1;
 }
 
-int32_t
-scraper_get_offset_to_char(scraper_t *scraper, char ch)
+static int
+_scraper_db_build_buckets(scraper_t *scraper)
 {
-    int rc;
-    int32_t offset;
-    char chstr[2] = {0};
-    char query[512] = {0};
-    sqlite3_stmt *get_offset_to_char;
+    uint32_t bucket;
+    sqlite3_stmt *stmt;
+    const char *query =
+        "SELECT CASE WHEN sort_key < 'a' THEN 0 WHEN sort_key >= '{' THEN ?1" \
+        " ELSE unicode(sort_key) - 96 END AS bucket, min(sort_key), count(*)" \
+        " FROM roms GROUP BY bucket";
+
+    if (sqlite3_prepare_v2(scraper->db, query, -1, &stmt, NULL) != SQLITE_OK)
+        return 1;
 
-    strcat(query, "SELECT count(name) FROM (SELECT name FROM roms ORDER BY name)" \
-                  "WHERE substr(lower(name),1,1) < ?");
+    sqlite3_bind_int(stmt, 1, SCRAPER_BUCKETS - 1);
+    memset(scraper->buckets, 0, sizeof(scraper->buckets));
 
-    if ((rc = sqlite3_prepare_v2(scraper->db, query, sizeof(query), &get_offset_to_char, NULL)) != SQLITE_OK)
+    while (sqlite3_step(stmt) == SQLITE_ROW)
     {
-        return 0;
+        bucket = sqlite3_column_int(stmt, 0);
+        if (bucket >= SCRAPER_BUCKETS)
+            continue;
+
+        snprintf(scraper->buckets[bucket].key, sizeof(scraper->buckets[bucket].key), "%s",
+                 sqlite3_column_text(stmt, 1) ? (const char *)sqlite3_column_text(stmt, 1) : "");
+        scraper->buckets[bucket].count = sqlite3_column_int(stmt, 2);
     }
 
-    chstr[0] = ch;
-    chstr[1] = '\0';
-    sqlite3_bind_text(get_offset_to_char, 1, chstr, -1, SQLITE_STATIC);
+    sqlite3_finalize(stmt);
+    return 0;
+}
 
-    offset = 0;
-    if (sqlite3_step(get_offset_to_char) == SQLITE_ROW)
-        offset = sqlite3_column_int64(get_offset_to_char,0);
+/*
+ * Bucket index for letter jumps, built with one grouped pass after
+ * the roms table changed so that a jump is a lookup plus a keyset page
+ * fetch from the bucket's first key.
+ */
+const scraper_bucket_t *
+scraper_get_buckets(scraper_t *scraper)
+{
+    if (!scraper->buckets_valid || scraper->buckets_generation != scraper->generation)
+    {
+        if (_scraper_db_build_buckets(scraper) != 0)
+            warning("scraper", "failed to build letter buckets");
 
-    sqlite3_finalize(get_offset_to_char);
-    return offset;
+        scraper->buckets_generation = scraper->generation;
+        scraper->buckets_valid = true;
+    }
+
+    return scraper->buckets;
 }
 
+int
+scraper_put_state(scraper_t *scraper, const char *rom_path, const scraper_state_entry_t *state)
+{
+    int rc;
+    sqlite3_stmt *put_state_stmt;
+    const char *query =
+        "INSERT INTO states(rom_path, slot, timestamp, size, core, core_version)" \
+        " VALUES(?, ?, ?, ?, ?, ?)" \
+        " ON CONFLICT(rom_path, slot) DO UPDATE SET" \
+        " timestamp=excluded.timestamp, size=excluded.size," \
+        " core=excluded.core, core_version=excluded.core_version";
+
+    if (sqlite3_prepare_v2(scraper->db, query, -1, &put_state_stmt, NULL) != SQLITE_OK)
+    {
+        return 1;
+    }
+
+    sqlite3_bind_text(put_state_stmt, 1, rom_path, -1, SQLITE_STATIC);
+    sqlite3_bind_int(put_state_stmt, 2, state->slot);
+    sqlite3_bind_int64(put_state_stmt, 3, state->timestamp);
+    sqlite3_bind_int64(put_state_stmt, 4, state->size);
+    sqlite3_bind_text(put_state_stmt, 5, state->core, -1, SQLITE_STATIC);
+    sqlite3_bind_text(put_state_stmt, 6, state->core_version, -1, SQLITE_STATIC);
+
+    rc = sqlite3_step(put_state_stmt);
+    sqlite3_finalize(put_state_stmt);
+
+    return (rc == SQLITE_DONE) ? 0 : 1;
+}
+
+int
+scraper_get_states(scraper_t *scraper, const char *rom_path,
+                   scraper_state_entry_t *result, size_t *size)
+{
+    size_t s;
+    sqlite3_stmt *get_states_stmt;
+    const char *query =
+        "SELECT slot, timestamp, size, core, core_version FROM states" \
+        " WHERE rom_path = ? ORDER BY slot";
+
+    if (sqlite3_prepare_v2(scraper->db, query, -1, &get_states_stmt, NULL) != SQLITE_OK)
+    {
+        return 1;
+    }
+
+    sqlite3_bind_text(get_states_stmt, 1, rom_path, -1, SQLITE_STATIC);
+
+    s = *size;
+    *size = 0;
+
+    while (*size < s && sqlite3_step(get_states_stmt) == SQLITE_ROW)
+    {
+        result[*size].slot = sqlite3_column_int(get_states_stmt, 0);
+        result[*size].timestamp = sqlite3_column_int64(get_states_stmt, 1);
+        result[*size].size = sqlite3_column_int64(get_states_stmt, 2);
+        snprintf(result[*size].core, sizeof(result[*size].core), "%s",
+                 (const char *)sqlite3_column_text(get_states_stmt, 3) ?: "");
+        snprintf(result[*size].core_version, sizeof(result[*size].core_version), "%s",
+                 (const char *)sqlite3_column_text(get_states_stmt, 4) ?: "");
+
+        (*size)++;
+    }
+
+    sqlite3_finalize(get_states_stmt);
+    return 0;
+}
@@ -22,6 +22,7 @@
 #ifndef _scraper_h
 #define _scraper_h
 
+#include <stdbool.h>
 #include <sqlite3.h>
 
 #include "romident.h"
@@ -31,21 +32,97 @@ typedef struct scraper_rom_entry_t  {
   const char *path;
   const char *name;
   const char *core;
+  /* normalized name the list is ordered by */
+  const char *key;
 } scraper_rom_entry_t;
 
+/* save state slot of a rom */
+typedef struct scraper_state_entry_t {
+  int32_t slot;
+  int64_t timestamp;
+  int64_t size;
+  char core[64];
+  char core_version[64];
+} scraper_state_entry_t;
+
+/*
+ * Letter jump buckets of the sort order, bucket 0 holds every key
+ * before 'a' (digits and punctuation), 1-26 the letters and the last
+ * one every key after 'z', including non-ASCII titles.
+ */
+#define SCRAPER_BUCKETS 28
+
+typedef struct scraper_bucket_t {
+  char key[256];
+  uint32_t count;
+} scraper_bucket_t;
+
+/* searches slower than the target are logged, past the budget interrupted */
+#define SCRAPER_SEARCH_TARGET_MS 20
+#define SCRAPER_SEARCH_BUDGET_MS 100
+
+/* rows written per transaction while scanning */
+#define SCRAPER_BATCH_SIZE 1000
+
+/* fingerprint of a rom row, used to skip unchanged files on rescan */
+typedef struct scraper_known_t {
+  char *path;
+  char *core;
+  int64_t size;
+  int64_t mtime;
+  bool seen;
+} scraper_known_t;
+
 typedef struct scraper_t {
   romident_t ident;
   sqlite3 *db;
+
+  /* state of a running scan */
+  sqlite3_stmt *add_rom_stmt;
+  uint32_t batch;
+  uint32_t rows;
+  uint32_t unchanged;
+  uint32_t removed;
+
+  /* bumped by each scan that changed the roms table */
+  uint32_t generation;
+
+  /* highest rowid of roms already in the search index */
+  int64_t fts_rowid;
+
+  /* the last search ran past SCRAPER_SEARCH_BUDGET_MS */
+  bool search_interrupted;
+
+  /* first key of each bucket, rebuilt when generation changes */
+  scraper_bucket_t buckets[SCRAPER_BUCKETS];
+  uint32_t buckets_generation;
+  bool buckets_valid;
+
+  scraper_known_t *known;
+  size_t known_count;
+  uint32_t *known_slots;
+  size_t known_mask;
 } scraper_t;
 
-int scraper_init(scraper_t *scraper);
+int scraper_init(scraper_t *scraper, const char *database);
 void scraper_deinit(scraper_t *scraper);
 
 int scraper_scan_directory(scraper_t *scraper, core_collection_t *core, const char *directory);
+int scraper_import_dat(scraper_t *scraper, const char *filename);
+
+int scraper_get_from(scraper_t *scraper, const char *key, const char *path, uint32_t limit,
+                     scraper_rom_entry_t *result, size_t *size);
+int scraper_get_before(scraper_t *scraper, const char *key, const char *path, uint32_t limit,
+                       scraper_rom_entry_t *result, size_t *size);
+
+int scraper_search(scraper_t *scraper, const char *text, uint32_t limit,
+                   scraper_rom_entry_t *result, size_t *size);
 
-int scraper_get_list(scraper_t *scraper, uint32_t index, uint32_t limit,
-                    scraper_rom_entry_t *result, size_t *size);
+uint32_t scraper_bucket_of(const char *key);
+const scraper_bucket_t *scraper_get_buckets(scraper_t *scraper);
 
-int32_t scraper_get_offset_to_char(scraper_t *scraper, char ch);
+int scraper_put_state(scraper_t *scraper, const char *rom_path, const scraper_state_entry_t *state);
+int scraper_get_states(scraper_t *scraper, const char *rom_path,
+                       scraper_state_entry_t *result, size_t *size);
 
 #endif /* _scraper_h */
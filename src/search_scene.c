@@ -0,0 +1,399 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include <SDL_ttf.h>
+
+#include "logger.h"
+#include "scene.h"
+#include "engine.h"
+#include "draw.h"
+
+/* screen rows: query, results and the on-screen keyboard */
+#define SEARCH_RESULTS 5
+#define KEYBOARD_ROWS 4
+#define KEYBOARD_COLUMNS 10
+#define SEARCH_ROWS (1 + SEARCH_RESULTS + KEYBOARD_ROWS)
+
+extern scene_t run_game_scene;
+
+/* '\b' erases the last character */
+static const char *keyboard_keys = "abcdefghijklmnopqrstuvwxyz0123456789-. \b";
+
+typedef struct {
+    int menu;
+    bool dirty;
+
+    char text[64];
+    size_t length;
+
+    /* shown instead of results when the last search failed */
+    const char *status;
+
+    struct {
+        scraper_rom_entry_t entries[SEARCH_RESULTS];
+        size_t entry_cnt;
+        int32_t index;
+        uint32_t generation;
+    } results;
+
+    struct {
+        int32_t row;
+        int32_t column;
+    } keyboard;
+
+} search_scene_data_t;
+
+static void
+_search_scene_free_results(search_scene_data_t *data)
+{
+    size_t i;
+
+    for (i = 0; i < data->results.entry_cnt; i++)
+    {
+        free((void *)data->results.entries[i].name);
+        free((void *)data->results.entries[i].path);
+        free((void *)data->results.entries[i].core);
+        free((void *)data->results.entries[i].key);
+    }
+
+    memset(data->results.entries, 0, sizeof(data->results.entries));
+    data->results.entry_cnt = 0;
+    data->results.index = 0;
+}
+
+/* run the search again, called on each keystroke */
+static void
+_search_scene_update_results(struct scene_t *scene)
+{
+    search_scene_data_t *data = scene->opaque;
+
+    _search_scene_free_results(data);
+    data->results.generation = scene->engine->scraper.generation;
+    data->status = NULL;
+    data->dirty = true;
+
+    if (data->length > 0)
+    {
+        data->results.entry_cnt = SEARCH_RESULTS;
+        if (scraper_search(&scene->engine->scraper, data->text, SEARCH_RESULTS,
+                           data->results.entries, &data->results.entry_cnt) != 0)
+        {
+            warning("search_scene", "failed to search for '%s'", data->text);
+            data->results.entry_cnt = 0;
+            data->status = "Search failed";
+        }
+
+        if (scene->engine->scraper.search_interrupted)
+            data->status = "Search timed out";
+    }
+
+    /* nothing left to select, a rescan may have emptied the list */
+    if (data->results.entry_cnt == 0)
+        data->menu = 0;
+}
+
+static void
+_search_scene_type_key(struct scene_t *scene)
+{
+    char key;
+    search_scene_data_t *data = scene->opaque;
+
+    key = keyboard_keys[data->keyboard.row * KEYBOARD_COLUMNS + data->keyboard.column];
+
+    if (key == '\b')
+    {
+        if (data->length == 0)
+            return;
+        /* drop a whole utf-8 sequence */
+        while (data->length > 0 && ((uint8_t)data->text[--data->length] & 0xc0) == 0x80);
+    }
+    else
+    {
+        if (data->length + 1 >= sizeof(data->text))
+            return;
+        data->text[data->length++] = key;
+    }
+
+    data->text[data->length] = '\0';
+    _search_scene_update_results(scene);
+}
+
+static void
+_search_scene_move_key(search_scene_data_t *data, int rows, int columns)
+{
+    data->keyboard.row = (data->keyboard.row + KEYBOARD_ROWS + rows) % KEYBOARD_ROWS;
+    data->keyboard.column = (data->keyboard.column + KEYBOARD_COLUMNS + columns) % KEYBOARD_COLUMNS;
+    data->dirty = true;
+}
+
+static int
+_search_scene_mount(struct scene_t *scene, void *opaque)
+{
+    search_scene_data_t *data = scene->opaque;
+
+    data->menu = 0;
+    data->text[0] = '\0';
+    data->length = 0;
+    data->keyboard.row = data->keyboard.column = 0;
+    _search_scene_update_results(scene);
+
+    return 0;
+}
+
+static void
+_search_scene_unmount(struct scene_t *scene)
+{
+    search_scene_data_t *data = scene->opaque;
+    _search_scene_free_results(data);
+}
+
+static void
+_search_scene_enter(struct scene_t *scene)
+{
+    search_scene_data_t *data = scene->opaque;
+    data->dirty = true;
+}
+
+static void
+_search_scene_leave(struct scene_t *scene)
+{
+}
+
+static void
+_search_scene_render_front(struct scene_t *scene, SDL_Renderer *renderer)
+{
+    int w, h;
+    size_t i;
+    char key[2] = {0}, label[80];
+    const char *text;
+    SDL_Rect d;
+    SDL_Color black = {0, 0, 0};
+    search_scene_data_t *data = scene->opaque;
+
+    SDL_GetRendererOutputSize(renderer, &w, &h);
+
+    d.x = d.y = 0;
+    d.w = w;
+    d.h = h / SEARCH_ROWS;
+
+    snprintf(label, sizeof(label), "Search: %s_", data->text);
+    draw_text(renderer, scene->engine->font, TTF_STYLE_BOLD,
+              black, ALIGN_LEFT, label, &d);
+
+    for (i = 0; i < data->results.entry_cnt; i++)
+    {
+        d.y += d.h;
+        draw_text(renderer, scene->engine->font, TTF_STYLE_NORMAL,
+                  black, ALIGN_LEFT, data->results.entries[i].name, &d);
+    }
+
+    if (data->status && data->results.entry_cnt == 0)
+    {
+        d.y += d.h;
+        draw_text(renderer, scene->engine->font, TTF_STYLE_NORMAL,
+                  black, ALIGN_LEFT, data->status, &d);
+    }
+
+    d.w = w / KEYBOARD_COLUMNS;
+    for (i = 0; keyboard_keys[i] != '\0'; i++)
+    {
+        d.x = (i % KEYBOARD_COLUMNS) * d.w;
+        d.y = (1 + SEARCH_RESULTS + i / KEYBOARD_COLUMNS) * d.h;
+
+        *key = keyboard_keys[i];
+        if (*key == ' ')
+            text = "spc";
+        else if (*key == '\b')
+            text = "del";
+        else
+            text = key;
+
+        draw_text(renderer, scene->engine->font, TTF_STYLE_NORMAL,
+                  black, ALIGN_CENTER, text, &d);
+    }
+}
+
+static void
+_search_scene_render_back(struct scene_t *scene, SDL_Renderer *renderer)
+{
+    int w, h;
+    SDL_Rect center;
+    search_scene_data_t *data = scene->opaque;
+
+    SDL_GetRendererOutputSize(renderer, &w, &h);
+    SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+    SDL_RenderClear(renderer);
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+    /* keyboard background */
+    center.x = 0;
+    center.w = w;
+    center.h = h / SEARCH_ROWS;
+    center.y = (1 + SEARCH_RESULTS) * center.h;
+    center.h *= KEYBOARD_ROWS;
+    SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0x10);
+    SDL_RenderFillRect(renderer, &center);
+
+    /* draw cursor highlight on the focused key or result */
+    center.h = h / SEARCH_ROWS;
+    if (data->menu == 0)
+    {
+        center.w = w / KEYBOARD_COLUMNS;
+        center.x = data->keyboard.column * center.w;
+        center.y = (1 + SEARCH_RESULTS + data->keyboard.row) * center.h;
+    }
+    else
+    {
+        center.x = 0;
+        center.w = w;
+        center.y = (1 + data->results.index) * center.h;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0x20);
+    SDL_RenderFillRect(renderer, &center);
+}
+
+static void
+_search_scene_render_overlay(struct scene_t *scene, SDL_Renderer *renderer)
+{
+}
+
+static int
+_search_scene_tick(struct scene_t *scene)
+{
+    search_scene_data_t *data = scene->opaque;
+
+    /* a rescan changed the library under the results */
+    if (data->results.generation != scene->engine->scraper.generation)
+        _search_scene_update_results(scene);
+
+    if (data->dirty == false)
+    {
+        SDL_Delay(25);
+        return 0;
+    }
+
+    data->dirty = false;
+    return 1;
+}
+
+static void
+_search_scene_handle_event(struct scene_t *scene, SDL_Event *event)
+{
+    search_scene_data_t *data = scene->opaque;
+
+    if (event->type != SDL_CONTROLLERBUTTONDOWN)
+        return;
+
+    if (data->menu == 0)
+    {
+        switch (event->cbutton.button)
+        {
+            case SDL_CONTROLLER_BUTTON_DPAD_UP:
+                _search_scene_move_key(data, -1, 0);
+                break;
+            case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+                _search_scene_move_key(data, 1, 0);
+                break;
+            case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+                _search_scene_move_key(data, 0, -1);
+                break;
+            case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+                _search_scene_move_key(data, 0, 1);
+                break;
+
+            case SDL_CONTROLLER_BUTTON_A:
+                _search_scene_type_key(scene);
+                break;
+
+            case SDL_CONTROLLER_BUTTON_X:
+                /* move focus to the results */
+                if (data->results.entry_cnt == 0)
+                    break;
+                data->menu = 1;
+                data->results.index = 0;
+                data->dirty = true;
+                break;
+
+            case SDL_CONTROLLER_BUTTON_B:
+            case SDL_CONTROLLER_BUTTON_Y:
+                engine_pop_scene(scene->engine);
+                break;
+        }
+    }
+    else
+    {
+        switch (event->cbutton.button)
+        {
+            case SDL_CONTROLLER_BUTTON_DPAD_UP:
+                if (data->results.index > 0)
+                    data->results.index--;
+                data->dirty = true;
+                break;
+            case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+                if (data->results.index < (int32_t)data->results.entry_cnt - 1)
+                    data->results.index++;
+                data->dirty = true;
+                break;
+
+            case SDL_CONTROLLER_BUTTON_A:
+                if (data->results.entry_cnt == 0)
+                    break;
+
+                /* start selected game */
+                if (engine_push_scene(scene->engine, &run_game_scene,
+                                      &data->results.entries[data->results.index]) != 0)
+                {
+                    warning("search_scene", "failed to start game");
+                }
+                data->dirty = true;
+                break;
+
+            case SDL_CONTROLLER_BUTTON_X:
+            case SDL_CONTROLLER_BUTTON_B:
+                /* back to the keyboard */
+                data->menu = 0;
+                data->dirty = true;
+                break;
+        }
+    }
+}
+
+search_scene_data_t _search_scene_data = {
+    0
+};
+
+scene_t search_scene = {
+    _search_scene_mount,
+    _search_scene_unmount,
+    _search_scene_enter,
+    _search_scene_leave,
+    _search_scene_render_back,
+    _search_scene_render_front,
+    _search_scene_render_overlay,
+    _search_scene_tick,
+    _search_scene_handle_event,
+    NULL,
+    &_search_scene_data
+};
@@ -0,0 +1,97 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory.h>
+
+#include "logger.h"
+#include "hash.h"
+#include "sram.h"
+
+int
+sram_init(sram_t *sram, core_t *core, const char *directory, const char *rom_path)
+{
+    int fd;
+    ssize_t len;
+    char *ps;
+    const char *basename;
+
+    memset(sram, 0, sizeof(sram_t));
+
+    if (core->api.retro_get_memory_data == NULL || core->api.retro_get_memory_size == NULL)
+        return 1;
+
+    sram->data = core->api.retro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
+    sram->size = core->api.retro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
+    if (sram->data == NULL || sram->size == 0)
+        return 1;
+
+    /* named after the rom like other libretro frontends do */
+    basename = strrchr(rom_path, '/');
+    basename = basename ? basename + 1 : rom_path;
+    snprintf(sram->filename, sizeof(sram->filename), "%s/%s", directory, basename);
+    ps = strrchr(sram->filename, '.');
+    if (ps && strchr(ps, '/') == NULL)
+        *ps = '\0';
+    strncat(sram->filename, ".srm", sizeof(sram->filename) - strlen(sram->filename) - 1);
+
+    fd = open(sram->filename, O_RDONLY);
+    if (fd >= 0)
+    {
+        len = read(fd, sram->data, sram->size);
+        close(fd);
+
+        if (len < 0)
+            warning("sram", "failed to read '%s'", sram->filename);
+        else if (len != sram->size)
+            warning("sram", "'%s' is %zd bytes, core expects %zu", sram->filename, len, sram->size);
+        else
+            notice("sram", "loaded %zu bytes from '%s'", sram->size, sram->filename);
+    }
+
+    /* content as loaded or initialized by the core is already on disk */
+    sram->hash = hash64(sram->data, sram->size, 0);
+    return 0;
+}
+
+int
+sram_flush(sram_t *sram, savestate_t *writer)
+{
+    uint64_t hash;
+
+    if (sram->data == NULL)
+        return 0;
+
+    hash = hash64(sram->data, sram->size, 0);
+    if (hash == sram->hash)
+        return 0;
+
+    if (savestate_write(writer, sram->data, sram->size, sram->filename) != 0)
+    {
+        error("sram", "failed to queue write of '%s'", sram->filename);
+        return 1;
+    }
+
+    sram->hash = hash;
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _sram_h
+#define _sram_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "core.h"
+#include "savestate.h"
+
+/*
+ * Battery backed save RAM of the running game, loaded from disk before
+ * the first frame and written back through the save state writer only
+ * when its content hash has changed since last write.
+ */
+typedef struct sram_t {
+    uint8_t *data;
+    size_t size;
+    uint64_t hash;
+    char filename[4096];
+} sram_t;
+
+int sram_init(sram_t *sram, core_t *core, const char *directory, const char *rom_path);
+int sram_flush(sram_t *sram, savestate_t *writer);
+
+#endif /* _sram_h */
@@ -0,0 +1,337 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "logger.h"
+#include "watcher.h"
+
+#define WATCHER_MASK (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | \
+                      IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static uint64_t
+_watcher_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+/* true if path is ancestor or below it */
+static bool
+_watcher_is_within(const char *path, const char *ancestor)
+{
+    size_t len = strlen(ancestor);
+    return strncmp(path, ancestor, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+static watcher_dir_t *
+_watcher_find(watcher_t *watcher, int wd)
+{
+    size_t i;
+
+    for (i = 0; i < watcher->dir_count; i++)
+    {
+        if (watcher->dirs[i].wd == wd)
+            return &watcher->dirs[i];
+    }
+
+    return NULL;
+}
+
+static void
+_watcher_remove(watcher_t *watcher, int wd)
+{
+    watcher_dir_t *dir = _watcher_find(watcher, wd);
+    if (dir == NULL)
+        return;
+
+    free(dir->path);
+    *dir = watcher->dirs[--watcher->dir_count];
+}
+
+/* stop watching path and every directory below it */
+static void
+_watcher_remove_tree(watcher_t *watcher, const char *path)
+{
+    size_t i = 0;
+
+    while (i < watcher->dir_count)
+    {
+        if (!_watcher_is_within(watcher->dirs[i].path, path))
+        {
+            i++;
+            continue;
+        }
+
+        /* removal moves the last entry into slot i */
+        inotify_rm_watch(watcher->fd, watcher->dirs[i].wd);
+        _watcher_remove(watcher, watcher->dirs[i].wd);
+    }
+}
+
+static int
+_watcher_add(watcher_t *watcher, const char *path)
+{
+    int wd;
+    watcher_dir_t *dir;
+
+    wd = inotify_add_watch(watcher->fd, path, WATCHER_MASK);
+    if (wd < 0)
+    {
+        warning("watcher", "failed to watch '%s': %s", path, strerror(errno));
+        return 1;
+    }
+
+    /* a directory already watched, as when created during the walk, keeps its entry */
+    dir = _watcher_find(watcher, wd);
+    if (dir == NULL)
+    {
+        if (watcher->dir_count == watcher->dir_capacity)
+        {
+            size_t capacity = watcher->dir_capacity ? watcher->dir_capacity * 2 : 64;
+            dir = realloc(watcher->dirs, capacity * sizeof(watcher_dir_t));
+            if (dir == NULL)
+                return 1;
+            watcher->dirs = dir;
+            watcher->dir_capacity = capacity;
+        }
+
+        dir = &watcher->dirs[watcher->dir_count++];
+        dir->wd = wd;
+        dir->path = NULL;
+    }
+
+    free(dir->path);
+    dir->path = strdup(path);
+    return 0;
+}
+
+static void
+_watcher_add_tree(watcher_t *watcher, const char *path)
+{
+    DIR *dir;
+    char child[4096];
+    struct dirent *entry;
+
+    if (_watcher_add(watcher, path) != 0)
+        return;
+
+    dir = opendir(path);
+    if (dir == NULL)
+        return;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_type != DT_DIR
+            || strcmp(entry->d_name, ".") == 0
+            || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        _watcher_add_tree(watcher, child);
+    }
+
+    closedir(dir);
+}
+
+/*
+ * Mark a directory as changed, a pending ancestor already covers it
+ * and pending descendants are folded into it.
+ */
+static void
+_watcher_mark(watcher_t *watcher, const char *path)
+{
+    size_t i, j;
+    char **pending;
+
+    for (i = 0; i < watcher->pending_count; i++)
+    {
+        if (_watcher_is_within(path, watcher->pending[i]))
+            return;
+    }
+
+    for (i = j = 0; i < watcher->pending_count; i++)
+    {
+        if (_watcher_is_within(watcher->pending[i], path))
+            free(watcher->pending[i]);
+        else
+            watcher->pending[j++] = watcher->pending[i];
+    }
+    watcher->pending_count = j;
+
+    if (watcher->pending_count == watcher->pending_capacity)
+    {
+        size_t capacity = watcher->pending_capacity ? watcher->pending_capacity * 2 : 16;
+        pending = realloc(watcher->pending, capacity * sizeof(char *));
+        if (pending == NULL)
+            return;
+        watcher->pending = pending;
+        watcher->pending_capacity = capacity;
+    }
+
+    watcher->pending[watcher->pending_count++] = strdup(path);
+}
+
+int
+watcher_init(watcher_t *watcher, const char *root, uint32_t delay_ms)
+{
+    memset(watcher, 0, sizeof(watcher_t));
+
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0)
+    {
+        error("watcher", "failed to initialize inotify: %s", strerror(errno));
+        return 1;
+    }
+
+    watcher->root = strdup(root);
+    watcher->delay_ms = delay_ms;
+    _watcher_add_tree(watcher, root);
+
+    notice("watcher", "watching %zu directories below '%s'", watcher->dir_count, root);
+    return 0;
+}
+
+void
+watcher_deinit(watcher_t *watcher)
+{
+    size_t i;
+
+    if (watcher->fd >= 0)
+        close(watcher->fd);
+
+    for (i = 0; i < watcher->dir_count; i++)
+        free(watcher->dirs[i].path);
+
+    for (i = 0; i < watcher->pending_count; i++)
+        free(watcher->pending[i]);
+
+    free(watcher->dirs);
+    free(watcher->pending);
+    free(watcher->root);
+    memset(watcher, 0, sizeof(watcher_t));
+    watcher->fd = -1;
+}
+
+/*
+ * Drain pending inotify events, once a burst has settled each changed
+ * directory is reported through changed(). Returns the number of
+ * directories reported.
+ */
+int
+watcher_poll(watcher_t *watcher, watcher_changed_t changed, void *opaque)
+{
+    size_t i, count;
+    ssize_t len;
+    char path[4096];
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    watcher_dir_t *dir;
+
+    if (watcher->fd < 0)
+        return 0;
+
+    while ((len = read(watcher->fd, buf, sizeof(buf))) > 0)
+    {
+        watcher->last_event = _watcher_now();
+
+        for (i = 0; i < len; i += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *)(buf + i);
+
+            /* events were lost, everything has to be rescanned */
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                _watcher_mark(watcher, watcher->root);
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED)
+            {
+                _watcher_remove(watcher, event->wd);
+                continue;
+            }
+
+            dir = _watcher_find(watcher, event->wd);
+            if (dir == NULL || (event->mask & IN_DELETE_SELF))
+                continue;
+
+            /*
+             * A moved directory keeps its watches under the old paths,
+             * they are dropped and a move within the tree is watched
+             * again by IN_MOVED_TO of its new parent.
+             */
+            if (event->mask & IN_MOVE_SELF)
+            {
+                snprintf(path, sizeof(path), "%s", dir->path);
+                _watcher_remove_tree(watcher, path);
+                continue;
+            }
+
+            if ((event->mask & IN_ISDIR) && (event->mask & IN_MOVED_FROM))
+            {
+                snprintf(path, sizeof(path), "%s/%s", dir->path, event->name);
+                _watcher_remove_tree(watcher, path);
+
+                /* the removal may have moved the dirs array */
+                dir = _watcher_find(watcher, event->wd);
+                if (dir == NULL)
+                    continue;
+            }
+
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+            {
+                snprintf(path, sizeof(path), "%s/%s", dir->path, event->name);
+                _watcher_add_tree(watcher, path);
+
+                /* the watch may have moved the dirs array */
+                dir = _watcher_find(watcher, event->wd);
+                if (dir == NULL)
+                    continue;
+            }
+
+            _watcher_mark(watcher, dir->path);
+        }
+    }
+
+    if (watcher->pending_count == 0
+        || _watcher_now() - watcher->last_event < watcher->delay_ms)
+        return 0;
+
+    count = watcher->pending_count;
+    for (i = 0; i < count; i++)
+    {
+        changed(opaque, watcher->pending[i]);
+        free(watcher->pending[i]);
+    }
+    watcher->pending_count = 0;
+
+    return count;
+}
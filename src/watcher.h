@@ -0,0 +1,58 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _watcher_h
+#define _watcher_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * inotify watcher of the rom tree, changes are coalesced per directory
+ * and reported once the tree has been quiet for delay milliseconds.
+ */
+typedef struct watcher_dir_t {
+    int wd;
+    char *path;
+} watcher_dir_t;
+
+typedef struct watcher_t {
+    int fd;
+    char *root;
+    uint32_t delay_ms;
+    uint64_t last_event;
+
+    watcher_dir_t *dirs;
+    size_t dir_count;
+    size_t dir_capacity;
+
+    char **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} watcher_t;
+
+typedef void (*watcher_changed_t)(void *opaque, const char *directory);
+
+int watcher_init(watcher_t *watcher, const char *root, uint32_t delay_ms);
+void watcher_deinit(watcher_t *watcher);
+int watcher_poll(watcher_t *watcher, watcher_changed_t changed, void *opaque);
+
+#endif /* _watcher_h */
@@ -0,0 +1,470 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "logger.h"
+#include "crc32.h"
+#include "zip.h"
+
+#define ZIP_EOCD_SIGNATURE 0x06054b50
+#define ZIP64_EOCD_SIGNATURE 0x06064b50
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+
+#define ZIP_EOCD_SIZE 22
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIZE 56
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_LOCAL_SIZE 30
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATE 8
+
+/* largest central directory read into memory */
+#define ZIP_DIRECTORY_MAX (64 * 1024 * 1024)
+
+static uint16_t
+_zip_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t
+_zip_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t
+_zip_u64(const uint8_t *p)
+{
+    return _zip_u32(p) | ((uint64_t)_zip_u32(p + 4) << 32);
+}
+
+static int
+_zip_pread(int fd, void *buf, size_t len, uint64_t offset)
+{
+    return pread(fd, buf, len, offset) == (ssize_t)len ? 0 : 1;
+}
+
+/*
+ * Locate the end of central directory record, it is followed by a
+ * comment of at most 64KB so the tail of the file is searched.
+ */
+static int
+_zip_find_directory(int fd, uint64_t file_size, uint64_t *offset, uint64_t *size, uint64_t *count)
+{
+    uint8_t *tail, *eocd = NULL, zip64[ZIP64_EOCD_SIZE];
+    size_t len, i;
+
+    len = file_size < ZIP_EOCD_SIZE + 0xffff ? file_size : ZIP_EOCD_SIZE + 0xffff;
+    if (len < ZIP_EOCD_SIZE)
+        return 1;
+
+    tail = malloc(len);
+    if (tail == NULL || _zip_pread(fd, tail, len, file_size - len) != 0)
+        goto fail;
+
+    for (i = len - ZIP_EOCD_SIZE + 1; i-- > 0;)
+    {
+        if (_zip_u32(tail + i) == ZIP_EOCD_SIGNATURE)
+        {
+            eocd = tail + i;
+            break;
+        }
+    }
+
+    if (eocd == NULL)
+        goto fail;
+
+    *count = _zip_u16(eocd + 10);
+    *size = _zip_u32(eocd + 12);
+    *offset = _zip_u32(eocd + 16);
+
+    /* zip64 archives store the real values in a separate record */
+    if ((*count == 0xffff || *size == 0xffffffff || *offset == 0xffffffff)
+        && eocd - tail >= ZIP64_LOCATOR_SIZE
+        && _zip_u32(eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIGNATURE
+        && _zip_pread(fd, zip64, sizeof(zip64), _zip_u64(eocd - ZIP64_LOCATOR_SIZE + 8)) == 0
+        && _zip_u32(zip64) == ZIP64_EOCD_SIGNATURE)
+    {
+        *count = _zip_u64(zip64 + 32);
+        *size = _zip_u64(zip64 + 40);
+        *offset = _zip_u64(zip64 + 48);
+    }
+
+    free(tail);
+    return 0;
+
+fail:
+    free(tail);
+    return 1;
+}
+
+/* apply the zip64 extended information extra field */
+static void
+_zip_entry_zip64(zip_entry_t *entry, const uint8_t *extra, size_t len)
+{
+    uint16_t id, size;
+    const uint8_t *p, *end;
+
+    while (len >= 4)
+    {
+        id = _zip_u16(extra);
+        size = _zip_u16(extra + 2);
+        if (size > len - 4)
+            return;
+
+        if (id == 0x0001)
+        {
+            p = extra + 4;
+            end = p + size;
+            if (entry->size == 0xffffffff && p + 8 <= end)
+                entry->size = _zip_u64(p), p += 8;
+            if (entry->compressed_size == 0xffffffff && p + 8 <= end)
+                entry->compressed_size = _zip_u64(p), p += 8;
+            if (entry->offset == 0xffffffff && p + 8 <= end)
+                entry->offset = _zip_u64(p);
+            return;
+        }
+
+        extra += 4 + size;
+        len -= 4 + size;
+    }
+}
+
+int
+zip_read_directory(const char *filename, zip_entry_t **entries, size_t *count)
+{
+    int fd;
+    struct stat st;
+    uint8_t *directory = NULL, *p, *end;
+    uint64_t offset, size, total;
+    size_t name_len, extra_len, comment_len;
+    zip_entry_t *entry, *result = NULL;
+
+    *entries = NULL;
+    *count = 0;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    if (fstat(fd, &st) != 0
+        || _zip_find_directory(fd, st.st_size, &offset, &size, &total) != 0
+        || size > ZIP_DIRECTORY_MAX || offset + size > (uint64_t)st.st_size)
+        goto fail;
+
+    /* a corrupt count must not size the allocation */
+    if (total > size / ZIP_CENTRAL_SIZE)
+        total = size / ZIP_CENTRAL_SIZE;
+
+    directory = malloc(size ? size : 1);
+    result = calloc(total ? total : 1, sizeof(zip_entry_t));
+    if (directory == NULL || result == NULL || _zip_pread(fd, directory, size, offset) != 0)
+        goto fail;
+
+    p = directory;
+    end = directory + size;
+    while (*count < total && p + ZIP_CENTRAL_SIZE <= end && _zip_u32(p) == ZIP_CENTRAL_SIGNATURE)
+    {
+        name_len = _zip_u16(p + 28);
+        extra_len = _zip_u16(p + 30);
+        comment_len = _zip_u16(p + 32);
+        if (p + ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len > end)
+            break;
+
+        entry = &result[*count];
+        entry->method = _zip_u16(p + 10);
+        entry->crc32 = _zip_u32(p + 16);
+        entry->compressed_size = _zip_u32(p + 20);
+        entry->size = _zip_u32(p + 24);
+        entry->offset = _zip_u32(p + 42);
+        _zip_entry_zip64(entry, p + ZIP_CENTRAL_SIZE + name_len, extra_len);
+
+        /* names that do not fit are skipped rather than truncated */
+        p += ZIP_CENTRAL_SIZE;
+        if (name_len < sizeof(entry->name))
+        {
+            memcpy(entry->name, p, name_len);
+            entry->name[name_len] = '\0';
+            (*count)++;
+        }
+        p += name_len + extra_len + comment_len;
+    }
+
+    free(directory);
+    close(fd);
+    *entries = result;
+    return 0;
+
+fail:
+    free(directory);
+    free(result);
+    close(fd);
+    return 1;
+}
+
+static int
+_zip_inflate(int fd, uint64_t offset, const zip_entry_t *entry, uint32_t *crc,
+             zip_read_cb_t callback, void *opaque)
+{
+    int res = 1, rc = Z_OK;
+    z_stream zs = {0};
+    ssize_t len;
+    uint64_t left = entry->compressed_size;
+    uint8_t *in, *buf;
+    const size_t size = 64 * 1024;
+
+    in = malloc(size);
+    buf = malloc(size);
+    if (in == NULL || buf == NULL || inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    {
+        free(in);
+        free(buf);
+        return 1;
+    }
+
+    while (rc != Z_STREAM_END && left > 0)
+    {
+        len = pread(fd, in, left < size ? left : size, offset);
+        if (len <= 0)
+            goto out;
+        offset += len;
+        left -= len;
+
+        zs.next_in = in;
+        zs.avail_in = len;
+        do
+        {
+            zs.next_out = buf;
+            zs.avail_out = size;
+            rc = inflate(&zs, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END)
+                goto out;
+
+            *crc = crc32_update(*crc, buf, size - zs.avail_out);
+            if (callback(opaque, buf, size - zs.avail_out) != 0)
+                goto out;
+        } while (zs.avail_out == 0 && rc != Z_STREAM_END);
+    }
+
+    res = (rc == Z_STREAM_END) ? 0 : 1;
+
+out:
+    inflateEnd(&zs);
+    free(in);
+    free(buf);
+    return res;
+}
+
+static int
+_zip_copy(int fd, uint64_t offset, const zip_entry_t *entry, uint32_t *crc,
+          zip_read_cb_t callback, void *opaque)
+{
+    ssize_t len;
+    uint64_t left = entry->size;
+    uint8_t buf[64 * 1024];
+
+    while (left > 0)
+    {
+        len = pread(fd, buf, left < sizeof(buf) ? left : sizeof(buf), offset);
+        if (len <= 0 || callback(opaque, buf, len) != 0)
+            return 1;
+
+        *crc = crc32_update(*crc, buf, len);
+        offset += len;
+        left -= len;
+    }
+
+    return 0;
+}
+
+/*
+ * Stream the data of a stored or deflated member to callback, a non
+ * zero return from the callback stops reading. Returns 0 only when the
+ * whole member was read and matched its crc.
+ */
+int
+zip_read(const char *filename, const zip_entry_t *entry, zip_read_cb_t callback, void *opaque)
+{
+    int fd, res = 1;
+    uint32_t crc = 0;
+    uint64_t offset;
+    uint8_t local[ZIP_LOCAL_SIZE];
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    if (_zip_pread(fd, local, sizeof(local), entry->offset) != 0
+        || _zip_u32(local) != ZIP_LOCAL_SIGNATURE)
+    {
+        close(fd);
+        return 1;
+    }
+
+    /* the local header has its own name and extra field lengths */
+    offset = entry->offset + ZIP_LOCAL_SIZE + _zip_u16(local + 26) + _zip_u16(local + 28);
+
+    if (entry->method == ZIP_METHOD_STORED)
+        res = _zip_copy(fd, offset, entry, &crc, callback, opaque);
+    else if (entry->method == ZIP_METHOD_DEFLATE)
+        res = _zip_inflate(fd, offset, entry, &crc, callback, opaque);
+    else
+        warning("zip", "unsupported compression method %u of '%s'", entry->method, entry->name);
+
+    if (res == 0 && crc != entry->crc32)
+    {
+        warning("zip", "crc mismatch of '%s' in '%s'", entry->name, filename);
+        res = 1;
+    }
+
+    close(fd);
+    return res;
+}
+
+static int
+_zip_write_cb(void *opaque, const uint8_t *data, size_t len)
+{
+    return write(*(int *)opaque, data, len) != (ssize_t)len;
+}
+
+/* extract a stored or deflated member, verified against its crc */
+int
+zip_extract(const char *filename, const zip_entry_t *entry, const char *destination)
+{
+    int out, res;
+    char tmp[4096];
+
+    /* a fresh name so a planted file or symlink is never followed */
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", destination);
+    out = mkstemp(tmp);
+    if (out < 0)
+        return 1;
+
+    res = zip_read(filename, entry, _zip_write_cb, &out);
+    close(out);
+
+    if (res == 0 && rename(tmp, destination) != 0)
+        res = 1;
+    if (res != 0)
+        unlink(tmp);
+
+    return res;
+}
+
+typedef struct zip_head_t {
+    uint8_t *data;
+    size_t size;
+    size_t len;
+} zip_head_t;
+
+static int
+_zip_head_cb(void *opaque, const uint8_t *data, size_t len)
+{
+    zip_head_t *head = opaque;
+
+    if (len > head->size - head->len)
+        len = head->size - head->len;
+    memcpy(head->data + head->len, data, len);
+    head->len += len;
+
+    /* stop inflating once the head is filled */
+    return head->len == head->size;
+}
+
+/* first bytes of a member, size is updated to the number read */
+int
+zip_read_head(const char *filename, const zip_entry_t *entry, uint8_t *data, size_t *size)
+{
+    zip_head_t head = { data, *size, 0 };
+
+    if (head.size == 0)
+        return 1;
+
+    zip_read(filename, entry, _zip_head_cb, &head);
+    *size = head.len;
+    return head.len == 0;
+}
+
+/* extract the member of an "archive.zip#member" path */
+int
+zip_extract_member(const char *path, const char *destination)
+{
+    int res = 1;
+    size_t i, count;
+    char archive[4096];
+    const char *member;
+    zip_entry_t *entries;
+
+    member = zip_member(path, archive, sizeof(archive));
+    if (member == NULL)
+        return 1;
+
+    if (zip_read_directory(archive, &entries, &count) != 0)
+        return 1;
+
+    for (i = 0; i < count; i++)
+    {
+        if (strcmp(entries[i].name, member) == 0)
+        {
+            res = zip_extract(archive, &entries[i], destination);
+            break;
+        }
+    }
+
+    free(entries);
+    return res;
+}
+
+/*
+ * Split an "archive.zip#member" path, returns the member and copies
+ * the archive path, or NULL if path does not address an archive member.
+ */
+const char *
+zip_member(const char *path, char *archive, size_t size)
+{
+    const char *sep;
+    size_t len;
+
+    for (sep = strchr(path, ZIP_MEMBER_SEPARATOR); sep; sep = strchr(sep + 1, ZIP_MEMBER_SEPARATOR))
+    {
+        len = sep - path;
+        if (len >= 4 && strncasecmp(sep - 4, ".zip", 4) == 0 && len < size)
+        {
+            memcpy(archive, path, len);
+            archive[len] = '\0';
+            return sep + 1;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of hjortron-frontend.
+ *
+ * Copyright 2018-2019 Henrik Andersson <henrik.4e@gmail.com>
+ *
+ * hjortron-frontend is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * hjortron-frontend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hjortron-frontend.  If not, see
+ * <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _zip_h
+#define _zip_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* roms inside an archive are addressed as "archive.zip#member" */
+#define ZIP_MEMBER_SEPARATOR '#'
+
+/*
+ * Entry of a zip central directory, names, sizes and crc are taken
+ * from the directory headers without reading the member data.
+ */
+typedef struct zip_entry_t {
+    char name[256];
+    uint32_t crc32;
+    uint16_t method;
+    uint64_t size;
+    uint64_t compressed_size;
+    uint64_t offset;
+} zip_entry_t;
+
+typedef int (*zip_read_cb_t)(void *opaque, const uint8_t *data, size_t len);
+
+int zip_read_directory(const char *filename, zip_entry_t **entries, size_t *count);
+int zip_read(const char *filename, const zip_entry_t *entry, zip_read_cb_t callback, void *opaque);
+int zip_read_head(const char *filename, const zip_entry_t *entry, uint8_t *data, size_t *size);
+int zip_extract(const char *filename, const zip_entry_t *entry, const char *destination);
+int zip_extract_member(const char *path, const char *destination);
+const char *zip_member(const char *path, char *archive, size_t size);
+
+#endif /* _zip_h */